@@ -0,0 +1,802 @@
+// Microbenchmarks of the hot path: indicator evaluation and protocol encoding,
+// run against a synthetic in-memory telemetry buffer, with the port closed
+// like with --no-wheel. It fails if any of it allocates from the heap once
+// warmed up, or if a result checked on the way is wrong.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+#include <fstream>
+
+#include <libconfig.h++>
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <rgb.h>
+#include <proto.h>
+#include <writer.h>
+#include <transport.h>
+#include <termios_transport.h>
+#include <emulator.h>
+#include <parser.h>
+#include <stats.h>
+#include <trace.h>
+#include "indicator.h"
+#include "engine.h"
+#include "leds_config.h"
+#include "snapshot.h"
+#include "frame_sync.h"
+#include "udp_source.h"
+
+using namespace std;
+
+namespace {
+
+atomic<unsigned long> allocations{0};
+
+} // namespace
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+const size_t telemetry_size = 32768;
+
+// everything measured is supposed to be allocation-free once warmed up,
+// any allocation fails the bench
+bool allocated = false;
+
+// and so does any result that isn't what it should be
+bool wrong = false;
+
+void check(bool ok, const string &what)
+{
+    if (ok) return;
+    cout << "  WRONG: " << what << endl;
+    wrong = true;
+}
+
+// ops per call of f
+template <typename F>
+void run(const string &name, unsigned int ops, F f)
+{
+    using clock = chrono::steady_clock;
+
+    for (int i = 0; i < 100; ++i) f(); // warm up
+
+    unsigned long n = 0;
+    const unsigned long a0 = allocations.load(memory_order_relaxed);
+    const auto t0 = clock::now();
+    auto t = t0;
+
+    while (t - t0 < chrono::milliseconds(200)) {
+        for (int i = 0; i < 100; ++i) f();
+        n += 100;
+        t = clock::now();
+    }
+
+    const double total = double(n) * ops;
+    const double ns = chrono::duration<double, nano>(t - t0).count() / total;
+    const double allocs = (allocations.load(memory_order_relaxed) - a0) / total;
+
+    cout << "  " << left << setw(36) << name << right
+         << fixed << setprecision(1) << setw(10) << ns << " ns/op"
+         << setprecision(3) << setw(10) << allocs << " allocs/op"
+         << (allocs > 0? "   ALLOCATES" : "") << endl;
+    allocated |= (allocs > 0);
+}
+
+// a value the config refers to, to be changed by sweep()
+struct field {
+    unsigned int offset;
+    string type;
+};
+
+void collect_fields(const libconfig::Setting &s, vector<field> &fields)
+{
+    if (s.isGroup() && s.exists("offset") && !s.exists("inv")) {
+        string type = "bool";
+
+        s.lookupValue("type", type);
+        fields.push_back({(unsigned int)(s.lookup("offset")), type});
+    }
+    if (s.isAggregate()) {
+        for (const auto &c: s) collect_fields(c, fields);
+    }
+}
+
+// makes the telemetry go up and down, RPM-like values 0..2550, bools blinking
+void sweep(uint8_t *data, const vector<field> &fields, unsigned int i)
+{
+    const unsigned int phase = i % 512;
+    const int v = (phase < 256? phase : 511 - phase) * 10;
+
+    for (const auto &f: fields) {
+        uint8_t *p = data + f.offset;
+
+        if (f.type == "float")          { float x = v; memcpy(p, &x, sizeof(x)); }
+        else if (f.type == "double")    { double x = v; memcpy(p, &x, sizeof(x)); }
+        else if (f.type == "int")       { int x = v; memcpy(p, &x, sizeof(x)); }
+        else if (f.type == "long")      { long x = v; memcpy(p, &x, sizeof(x)); }
+        else                            *p = (i / 16) & 1;
+    }
+}
+
+// write syscalls of the whole process so far, the emulator's included
+unsigned long write_syscalls()
+{
+    ifstream io("/proc/self/io");
+    string key;
+    unsigned long v;
+
+    while (io >> key >> v) {
+        if (key == "syscw:") return v;
+    }
+    return 0;
+}
+
+// through the pty emulator with the given transport backend: from a change
+// in the telemetry to the mask frame received by the device, and how many
+// frames per second get through
+void bench_wire(uint8_t *data, const vector<field> &fields, snapshot &snap, engine &rpm_engine,
+                const string &backend)
+{
+    using clock = moza::emulator::clock;
+
+    moza::emulator emu;
+    auto port_p = moza::make_transport(backend);
+    auto &port = *port_p;
+
+    port.open(emu.path());
+    cout << "  " << backend << " transport" << endl;
+
+    atomic<uint32_t> seen_mask{0};
+    atomic<clock::rep> seen_at{0};
+    atomic<unsigned long> frames{0};
+    atomic<unsigned long> bytes{0};
+
+    emu.on_frame([&](const moza::emulator::received &r) {
+        frames.fetch_add(1, memory_order_relaxed);
+        bytes.fetch_add(r.data.size(), memory_order_relaxed);
+        if (r.ok && r.data[4] == 0x1a && r.data[5] == moza::RPM) {
+            seen_mask.store(r.data[6] | r.data[7] << 8 | r.data[8] << 16 | uint32_t(r.data[9]) << 24);
+            seen_at.store(r.t.time_since_epoch().count());
+        }
+    });
+
+    moza::writer wr(port, moza::shadow());
+    vector<moza::color_n> colors;
+    vector<double> latency;
+    uint32_t mask;
+
+    colors.reserve(rpm_engine.size());
+
+    for (unsigned int i = 0; i < 1000; ++i) {
+        // all the way down or up
+        sweep(data, fields, i % 2? 255 : 0);
+
+        const auto t0 = clock::now();
+
+        snap.take(data);
+        rpm_engine.evaluate(snap.data(), mask, colors);
+        wr.submit(moza::RPM, mask, colors);
+        wr.post();
+
+        if (i == 0) continue;   // the first one has nothing to differ from
+
+        while (seen_mask.load() != mask && clock::now() - t0 < chrono::milliseconds(100)) {
+            this_thread::yield();
+        }
+        if (seen_mask.load() == mask) {
+            latency.push_back(chrono::duration<double, micro>(clock::duration(seen_at.load()) - t0.time_since_epoch()).count());
+        }
+    }
+
+    if (!latency.empty()) {
+        sort(latency.begin(), latency.end());
+        cout << "  " << left << setw(36) << "telemetry change to wire" << right
+             << fixed << setprecision(1) << setw(10) << latency[latency.size() / 2] << " us p50"
+             << setw(10) << latency[latency.size() * 99 / 100] << " us p99" << endl;
+    }
+
+    // as fast as the loop can go
+    frames.store(0);
+    bytes.store(0);
+
+    const auto t0 = clock::now();
+    const unsigned long w0 = write_syscalls();
+    unsigned int i = 0;
+
+    while (clock::now() - t0 < chrono::milliseconds(500)) {
+        sweep(data, fields, i++);
+        snap.take(data);
+        rpm_engine.evaluate(snap.data(), mask, colors);
+        wr.submit(moza::RPM, mask, colors);
+        wr.post();
+    }
+    this_thread::sleep_for(chrono::milliseconds(50));
+
+    const double t = chrono::duration<double>(clock::now() - t0).count();
+    const double w = double(write_syscalls() - w0) / i;
+
+    cout << "  " << left << setw(36) << "through the pty, cycles/s" << right
+         << fixed << setprecision(0) << setw(10) << i / t << ","
+         << setw(8) << frames.load() / t << " frames/s,"
+         << setw(9) << bytes.load() / t << " B/s" << endl;
+    cout << "  " << left << setw(36) << "write syscalls per cycle" << right
+         << fixed << setprecision(2) << setw(10) << w << endl;
+
+    // the queue has overflowed on the way, the last state still gets there
+    const auto t1 = clock::now();
+
+    while (seen_mask.load() != mask && clock::now() - t1 < chrono::milliseconds(500)) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    check(seen_mask.load() == mask, string(backend) + ": the last state posted isn't shown");
+}
+
+void bench_config(libconfig::Config &cfg, const string &title)
+{
+    using namespace libconfig;
+
+    cout << title << endl;
+
+    alignas(64) static uint8_t data[telemetry_size];
+    memset(data, 0, sizeof(data));
+
+    // make it look active
+    for (const auto &s: cfg.lookup("active")) {
+        int offset;
+        bool inv = false;
+
+        if (s.lookupValue("offset", offset)) {
+            s.lookupValue("inv", inv);
+            data[offset] = !inv;
+        }
+    }
+
+    // each of the devices list, or the root for the only one
+    vector<const Setting*> devices;
+
+    if (cfg.exists("devices")) {
+        for (const Setting &d: cfg.lookup("devices")) devices.push_back(&d);
+    } else {
+        devices.push_back(&cfg.getRoot());
+    }
+
+    vector<field> fields;
+
+    for (const Setting *ds: devices) {
+        if (ds->exists("rpm")) collect_fields(ds->lookup("rpm"), fields);
+        if (ds->exists("button_leds")) collect_fields(ds->lookup("button_leds"), fields);
+    }
+
+    // totals for percent levels
+    for (auto &f: fields) {
+        if (f.type != "bool") {
+            float x = 2300;
+            memcpy(data + f.offset, &x, sizeof(x));
+        }
+    }
+    sweep(data, fields, 200);
+
+    // all the indicators, as they are on their own
+    vector<indicator> all;
+
+    for (const Setting *ds: devices) {
+        if (ds->exists("rpm")) {
+            for (const Setting &c: ds->lookup("rpm.leds")) all.emplace_back(c, data);
+        }
+        if (ds->exists("button_leds")) {
+            for (const Setting &c: ds->lookup("button_leds")) all.emplace_back(c, data);
+        }
+    }
+
+    const unsigned int n = all.size();
+
+    run("indicator::update", n, [&] {
+        for (auto &i: all) i.update();
+    });
+
+    volatile bool on_sink;
+    run("indicator::is_on", n, [&] {
+        for (const auto &i: all) on_sink = i.is_on();
+    });
+
+    volatile unsigned int color_sink;
+    run("indicator::color", n, [&] {
+        for (const auto &i: all) color_sink = get<0>(i.color().rgb());
+    });
+
+    // and compiled as leds4sim does, on the snapshot; the idle button colors
+    // don't matter here
+    const vector<vector<moza::color_n> > idle(devices.size(), vector<moza::color_n>(14));
+    leds_config lc(cfg, idle, data, telemetry_size);
+    // the first device with each, for the single set benches
+    engine *rpm_engine = nullptr;
+    engine *btn_engine = nullptr;
+
+    for (auto &d: lc.devices) {
+        if (!rpm_engine && d.rpm_engine.size()) rpm_engine = &d.rpm_engine;
+        if (!btn_engine && d.btn_engine.size()) btn_engine = &d.btn_engine;
+    }
+
+    vector<moza::color_n> colors;
+    uint32_t mask;
+
+    colors.reserve(moza::max_leds);
+    lc.snap.take(data);
+
+    if (rpm_engine) {
+        run("engine::evaluate (rpm)", 1, [&] {
+            rpm_engine->evaluate(lc.snap.data(), mask, colors);
+        });
+    }
+    if (btn_engine) {
+        run("engine::evaluate (buttons)", 1, [&] {
+            btn_engine->evaluate(lc.snap.data(), mask, colors);
+        });
+    }
+
+    // the same with the RPM predicted, a new time every cycle
+    const Setting &first = *devices.front();
+
+    if (first.exists("rpm.value") && !first.exists("rpm.value.predict")) {
+        first.lookup("rpm.value").add("predict", Setting::TypeGroup).add("order", Setting::TypeInt) = 2;
+
+        leds_config predicted(cfg, idle, data, telemetry_size);
+        auto &e = predicted.devices.front().rpm_engine;
+        int64_t t = 0;
+
+        predicted.snap.take(data);
+        run("engine::evaluate (rpm, predicted)", 1, [&] {
+            e.set_time(t += 20000000, 30000000);
+            e.evaluate(predicted.snap.data(), mask, colors);
+        });
+    }
+
+    moza::termios_transport port; // closed
+    vector<unique_ptr<moza::writer> > writers;
+    vector<moza::color_n> btn_colors;
+    vector<moza::color_n> rpm_colors;
+    unsigned int i = 0;
+
+    for (size_t k = 0; k < lc.devices.size(); ++k) {
+        writers.push_back(make_unique<moza::writer>(port, moza::shadow()));
+    }
+    btn_colors.reserve(moza::max_leds);
+    rpm_colors.reserve(moza::max_leds);
+
+    // the body of the loop in main(), without the scheduling
+    run("main loop iteration", 1, [&] {
+        sweep(data, fields, i++);
+        lc.snap.take(data);
+
+        for (const auto &p: lc.activity_flags) {
+            if (!(bool(lc.snap.data()[p.first]) ^ p.second)) return;
+        }
+        if (!lc.snap.changed()) return;
+
+        for (size_t k = 0; k < lc.devices.size(); ++k) {
+            auto &d = lc.devices[k];
+            auto &wr = *writers[k];
+
+            if (d.btn_engine.size()) {
+                d.btn_engine.evaluate(lc.snap.data(), mask, btn_colors);
+                wr.submit(moza::BUTTON, mask | d.unused, btn_colors);
+            }
+            if (d.rpm_engine.size()) {
+                d.rpm_engine.evaluate(lc.snap.data(), mask, rpm_colors);
+                wr.submit(moza::RPM, mask, rpm_colors);
+            }
+            wr.post();
+        }
+    });
+
+    if (!rpm_engine) return;
+    for (const char *backend: {"native", "libserial"}) {
+        try {
+            bench_wire(data, fields, lc.snap, *rpm_engine, backend);
+        } catch (const exception &e) {
+            cout << "  no pty emulator: " << e.what() << endl;
+        }
+    }
+}
+
+void bench_protocol()
+{
+    cout << "protocol" << endl;
+
+    const vector<uint8_t> frame = {0x7e, 6, 0x3f, 0x17, 0x1a, 0, 0xff, 0x03, 0, 0};
+    volatile uint8_t sum_sink;
+
+    run("moza::chksum", 1, [&] {
+        sum_sink = moza::chksum(frame);
+    });
+
+    moza::termios_transport port; // closed
+    vector<moza::color_n> colors;
+
+    for (uint8_t n = 0; n < 10; ++n) {
+        colors.push_back(make_pair(n, RGB::from_int(0x10101 * n)));
+    }
+
+    run("moza::set_telemetry_colors (10)", 1, [&] {
+        moza::set_telemetry_colors(port, moza::RPM, colors);
+    });
+
+    unsigned int mask = 0;
+
+    run("moza::send_telemetry", 1, [&] {
+        moza::send_telemetry(port, moza::RPM, ++mask);
+    });
+
+    moza::batch b(port);
+
+    run("batched colors + mask", 1, [&] {
+        moza::set_telemetry_colors(b, moza::RPM, colors);
+        moza::send_telemetry(b, moza::RPM, ++mask);
+        moza::flush(port, b);
+    });
+
+    // what the batch above makes, with start bytes in the payload and only
+    // the checksum escaped, in pieces of a typical read size
+    colors[3].second = RGB(0x7e, 0x7e, 0x10);
+    b.clear();
+    moza::set_telemetry_colors(b, moza::RPM, colors);
+    moza::send_telemetry(b, moza::RPM, 0x7e7e7e7e);
+
+    moza::parser in(moza::parser::CHECKSUM);
+    unsigned int parsed = 0;
+    const unsigned int frames = 3;
+
+    run("moza::parser (per frame)", frames, [&] {
+        for (size_t i = 0; i < b.size(); i += 32) {
+            in.feed(b.data() + i, min<size_t>(32, b.size() - i));
+            while (in.next()) parsed += in.ok();
+        }
+    });
+    check(parsed % frames == 0 && !in.bad() && !in.skipped(),
+          "parser: " + to_string(in.bad()) + " bad frames, " + to_string(in.skipped()) + " bytes skipped");
+
+    // more than a batch holds goes out in several writes
+    bool overflowed = false;
+
+    b.clear();
+    try {
+        for (size_t i = 0; i <= moza::batch::capacity / 10; ++i) moza::send_telemetry(b, moza::RPM, i);
+    } catch (const exception &) {
+        overflowed = true;
+    }
+    check(!overflowed && b.size() < moza::batch::capacity, "batch doesn't flush when full");
+
+    // what recording the stats costs the hot path
+    int64_t ns = 0;
+
+    run("moza::counter::add", 1, [&] {
+        moza::metrics->frames.add();
+    });
+    run("moza::histogram::record", 1, [&] {
+        moza::metrics->cycle.record(ns += 997);
+    });
+
+    // and tracing a typical cycle's write
+    run("moza::trace::record (mask frame)", 1, [&] {
+        moza::wire.record(moza::trace::TX, -1, frame.data(), frame.size());
+    });
+}
+
+// a socket sending to in, -1 if there's none
+int udp_sender(const udp_source &in)
+{
+    const int out = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    sockaddr_in a = {};
+
+    a.sin_family = AF_INET;
+    a.sin_port = htons(in.port());
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (out < 0 || connect(out, reinterpret_cast<sockaddr*>(&a), sizeof(a)) < 0) {
+        cout << "  no UDP sender: " << strerror(errno) << endl;
+        if (out >= 0) close(out);
+        return -1;
+    }
+    return out;
+}
+
+// the image is the last datagram, zero-padded if it's short, and gone once
+// nothing has come for the timeout
+// an RPM bar of one LED, showing the float at offset
+string float_at(long offset)
+{
+    return "rpm: { value: { offset: " + to_string(offset) + ", type: \"float\" }\n"
+           "leds: ({ n: 1, color: \"green\", level: 1 }) }\n";
+}
+
+// if leds_config takes the config for a telemetry of size bytes, up to
+// telemetry_size
+bool config_fits(const string &text, size_t size)
+{
+    using namespace libconfig;
+
+    alignas(64) static uint8_t data[telemetry_size];
+    const vector<vector<moza::color_n> > idle(1, vector<moza::color_n>(14));
+    Config cfg;
+
+    cfg.setAutoConvert(true);
+    cfg.readString(text);
+    try {
+        leds_config lc(cfg, idle, data, size);
+    } catch (const runtime_error &) {
+        return false;
+    }
+    return true;
+}
+
+void check_udp()
+{
+    const size_t size = 64;
+    const unsigned int timeout_ms = 50;
+    udp_source in("127.0.0.1", 0, size, timeout_ms);
+    const int out = udp_sender(in);
+
+    if (out < 0) {
+        wrong = true;
+        return;
+    }
+
+    auto send_fill = [&](uint8_t v, size_t len) {
+        const vector<uint8_t> d(len, v);
+
+        check(send(out, d.data(), d.size(), 0) == ssize_t(d.size()), "udp send");
+    };
+    auto receive = [&] {
+        pollfd p = {in.fd(), POLLIN, 0};
+
+        ::poll(&p, 1, 1000);
+        return in.poll();
+    };
+    auto image_is = [&](uint8_t v, size_t len) {
+        const volatile uint8_t *d = in.data();
+
+        if (!d) return false;
+        for (size_t i = 0; i < size; ++i) {
+            if (d[i] != (i < len? v : 0)) return false;
+        }
+        return true;
+    };
+
+    // the offsets of a config are within the datagrams, not any mapping
+    check(config_fits("active: ()\n" + float_at(in.size() - 4), in.size()),
+          "a value at the end of a datagram is refused");
+    check(!config_fits("active: ()\n" + float_at(in.size() - 3), in.size()),
+          "a value one past the end of a datagram is accepted");
+
+    send_fill(0xaa, size);
+    send_fill(0xbb, size);
+    check(receive(), "udp_source::poll() doesn't see the game come");
+    check(image_is(0xbb, size), "udp_source image isn't the last datagram");
+
+    // into the other bank, then a short one where 0xaa was
+    send_fill(0xcc, size);
+    check(!receive() && image_is(0xcc, size), "udp_source image isn't the last datagram");
+    send_fill(0xdd, 10);
+    check(!receive() && image_is(0xdd, 10), "udp_source image of a short datagram isn't zero-padded");
+
+    this_thread::sleep_for(chrono::milliseconds(timeout_ms + 20));
+    check(in.poll(), "udp_source::poll() doesn't see the game gone after the timeout");
+    check(!in.data(), "udp_source image still there after the timeout");
+    close(out);
+}
+
+// a sim on this host sending faster than leds4sim samples: a cycle takes
+// the latest of the few datagrams that have come since the last one
+void bench_udp()
+{
+    cout << "telemetry source" << endl;
+
+    check_udp();
+
+    udp_source in("127.0.0.1", 0, 1500, 1000);
+    const int out = udp_sender(in);
+
+    if (out < 0) return;
+
+    const unsigned int burst = 4;
+    vector<uint8_t> packet(1200, 0);
+    uint32_t seq = 0;
+
+    run("udp send + udp_source::poll", burst, [&] {
+        for (unsigned int i = 0; i < burst; ++i) {
+            ++seq;
+            memcpy(packet.data(), &seq, sizeof(seq));
+            if (send(out, packet.data(), packet.size(), 0) < 0) break;
+        }
+        in.poll();
+    });
+
+    uint32_t latest = 0;
+
+    if (in.data()) memcpy(&latest, const_cast<const uint8_t*>(in.data()), sizeof(latest));
+    check(latest == seq, "udp_source: image of datagram " + to_string(latest) +
+                         ", the last sent was " + to_string(seq));
+    cout << "  " << in.received() << " datagrams received, " << in.skipped() << " skipped for newer ones" << endl;
+    close(out);
+}
+
+// the game updating every 5 ms, and the loop taking three times that to
+// evaluate one: each update is either seen or missed, also when it's there
+// before the wait
+void check_frame_sync()
+{
+    alignas(64) static uint8_t data[64];
+    span_set spans;
+
+    spans.add(0, 4);
+
+    snapshot snap(spans);
+    atomic<bool> done{false};
+    const auto period = chrono::milliseconds(5);
+
+    snap.set_counter(0, 4);
+    memset(data, 0, sizeof(data));
+
+    // the counter is the periods gone by: woken up late, it skips the
+    // update it was late for, as if written and overwritten
+    thread game([&] {
+        const auto t0 = chrono::steady_clock::now();
+
+        while (!done.load()) {
+            const uint32_t c = (chrono::steady_clock::now() - t0) / period;
+
+            *reinterpret_cast<volatile uint32_t*>(data) = c;
+            this_thread::sleep_until(t0 + (c + 1) * period);
+        }
+    });
+
+    frame_sync frames(100);
+
+    // learned from updates waited for
+    snap.take(data);
+    for (int i = 0; i < 40 && frames.wait(snap, data); ++i) snap.take(data);
+
+    const uint64_t counter0 = snap.taken_counter();
+    const auto stats0 = frames.stats();
+
+    // then each one there already, two overwritten before it
+    for (int i = 0; i < 50; ++i) {
+        this_thread::sleep_for(3 * period);
+        if (!frames.wait(snap, data)) break;
+        snap.take(data);
+    }
+
+    const int64_t written = snap.taken_counter() - counter0;
+    const int64_t counted = (frames.stats().frames - stats0.frames) + (frames.stats().missed - stats0.missed);
+
+    done.store(true);
+    game.join();
+
+    check(abs(frames.period_ns() - 5000000) < 1000000,
+          "frame_sync: learned " + to_string(frames.period_ns()) + " ns between updates of 5 ms");
+    check(abs(counted - written) <= written / 10,
+          "frame_sync: " + to_string(counted) + " updates seen or missed of " + to_string(written));
+}
+
+// what a config refers to has to be within the telemetry, the very end
+// included
+void check_bounds()
+{
+    const long last = telemetry_size - 4;
+
+    // all the same but for one offset
+    check(config_fits("active: ()\n" + float_at(last), telemetry_size),
+          "a value at the end of the telemetry is refused");
+    check(!config_fits("active: ()\n" + float_at(last + 1), telemetry_size),
+          "a value one past the end is accepted");
+    check(!config_fits("active: ()\n" + float_at(-1), telemetry_size), "a negative offset is accepted");
+    check(!config_fits("active: ({ offset: " + to_string(telemetry_size) + " })\n" + float_at(0), telemetry_size),
+          "an activity flag one past the end is accepted");
+    check(!config_fits("active: ()\nframe_counter: { offset: " + to_string(last + 1) + " }\n" + float_at(0),
+                       telemetry_size),
+          "a frame counter one past the end is accepted");
+}
+
+// many multi-level LEDs, to see how evaluation scales
+string synthetic_config()
+{
+    static const char *const colors = "(\"green\", \"yellow\", \"gold\", \"red\", \"magenta\", \"blue\", \"cyan\", \"white\")";
+    string s = "active: ({ offset: 0 })\n"
+               "rpm: { value: { offset: 16, type: \"float\", total: { offset: 20, type: \"float\" } }\n"
+               "leds: (\n";
+
+    for (int n = 1; n <= 32; ++n) {
+        s += "{ n: " + to_string(n) + ", color: " + colors + ", level: (";
+        for (int l = 0; l < 8; ++l) {
+            s += to_string(n * 50 + l * 200) + (l < 7? ", " : "");
+        }
+        s += n % 4? ") },\n" : "), value: { offset: " + to_string(24 + n * 4) + ", type: \"int\" } },\n";
+    }
+    s += ") }\nbutton_leds: (\n";
+    for (int n = 1; n <= 14; ++n) {
+        s += "{ n: " + to_string(n) + ", color: \"green\", value: { offset: " + to_string(300 + n) + " } },\n";
+    }
+    s += ")\n";
+    return s;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    using namespace libconfig;
+
+    bench_protocol();
+    bench_udp();
+    check_bounds();
+    check_frame_sync();
+
+    vector<string> files;
+
+    for (int i = 1; i < argc; ++i) files.push_back(argv[i]);
+    if (files.empty()) files.push_back(LEDS4SIM_CONF);
+
+    try {
+        for (const auto &f: files) {
+            Config cfg;
+
+            cfg.setAutoConvert(true);
+            cfg.readFile(f);
+            bench_config(cfg, f);
+        }
+
+        Config cfg;
+
+        cfg.setAutoConvert(true);
+        cfg.readString(synthetic_config());
+        bench_config(cfg, "synthetic: 32 LEDs x 8 levels, 14 buttons");
+    } catch (const ParseException &ex) {
+        cerr << "config parse error " << ex.getFile() << ":" << ex.getLine()
+             << " - " << ex.getError() << std::endl;
+        return EXIT_FAILURE;
+    } catch (const FileIOException &) {
+        cerr << "can't read config" << endl;
+        return EXIT_FAILURE;
+    } catch (const SettingException &e) {
+        cerr << "config: " << e.what() << " at " << e.getPath() << endl;
+        return EXIT_FAILURE;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (allocated) {
+        cerr << "heap allocations on the hot path" << endl;
+        return EXIT_FAILURE;
+    }
+    if (wrong) {
+        cerr << "wrong results" << endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
@@ -0,0 +1,333 @@
+#include "engine.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <cstring>
+
+namespace {
+
+// SSE2 wide, which any x86-64 has, GCC makes it plain code elsewhere
+typedef double v2df __attribute__((vector_size(16)));
+typedef int64_t v2di __attribute__((vector_size(16)));
+
+template <typename T>
+double read(const uint8_t *p)
+{
+    T v;
+
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t value_size(indicator::val_type t)
+{
+    switch (t) {
+    case indicator::INT:    return sizeof(int);
+    case indicator::LONG:   return sizeof(long);
+    case indicator::FLOAT:  return sizeof(float);
+    case indicator::DOUBLE: return sizeof(double);
+    default:                return sizeof(bool);
+    }
+}
+
+} // namespace
+
+engine::engine(const std::vector<indicator> &indicators)
+    : m_stride(1)
+{
+    std::vector<size_t> order(indicators.size());
+
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+        return indicators[a].m_p.index() < indicators[b].m_p.index();
+    });
+
+    for (const auto &i: indicators) {
+        m_stride = std::max(m_stride, i.m_levels.size());
+    }
+    // keep the rows a whole number of vectors
+    m_stride = (m_stride + 3) & ~size_t(3);
+
+    const size_t n = indicators.size();
+    const size_t row = m_stride + 1;
+
+    m_offset.reserve(n);
+    m_n.reserve(n);
+    m_multicolor.reserve(n);
+    m_value.assign(n, 0.0);
+    m_count.assign(n, 0);
+    m_levels.assign(n * m_stride, std::numeric_limits<double>::max());
+    m_on.assign(n * row, 0);
+    m_colors.assign(n * row, RGB::black);
+    m_group.fill(n);
+    m_out.resize(n);
+
+    for (size_t j = 0; j < n; ++j) {
+        const auto &ind = indicators[order[j]];
+        const auto t = indicator::val_type(ind.m_p.index());
+        const bool is_bool = (t == indicator::BOOL);
+
+        m_group[t] = std::min(m_group[t], j);
+        m_offset.push_back(ind.m_offset);
+        m_n.push_back(ind.n());
+        m_multicolor.push_back(ind.is_multicolor());
+
+        double *levels = &m_levels[j * m_stride];
+        uint8_t *on = &m_on[j * row];
+        RGB *colors = &m_colors[j * row];
+
+        if (ind.m_hysteresis > 0 || ind.m_hold[0] > 0 || ind.m_hold[1] > 0) {
+            m_settle.push_back({j, ind.m_hysteresis, {ind.m_hold[0], ind.m_hold[1]}, 0, 0,
+                                -std::numeric_limits<double>::infinity()});
+        }
+
+        if (ind.m_predict) {
+            m_predict.push_back({j, ind.m_predict, ind.m_predict_ahead, 0, {}, {}});
+        }
+
+        if (is_bool) {
+            // 0 or 1 reaches this one or not
+            levels[0] = 0.5;
+            on[0] = ind.m_inv[0];
+            on[1] = !ind.m_inv[0];
+            std::fill_n(on + 2, row - 2, on[1]);
+            std::fill_n(colors, row, ind.m_colors[0]);
+            continue;
+        }
+
+        std::copy(ind.m_levels.begin(), ind.m_levels.end(), levels);
+
+        // none reached: off, unless inverted
+        on[0] = ind.m_inv[0];
+        colors[0] = ind.is_multicolor()? RGB::black : ind.m_colors[0];
+
+        for (size_t k = 1; k <= ind.m_levels.size(); ++k) {
+            on[k] = !ind.m_inv[k - 1];
+            colors[k] = ind.m_colors[std::min(k - 1, ind.m_colors.size() - 1)];
+        }
+        // in case a value is beyond even the padding
+        const size_t last = ind.m_levels.size();
+
+        std::fill(on + last + 1, on + row, on[last]);
+        std::fill(colors + last + 1, colors + row, colors[last]);
+
+        if (!ind.m_levels_p.empty()) {
+            const bool has_offset = (ind.m_total_p.index() != indicator::INT ||
+                                     std::get<indicator::INT>(ind.m_total_p) != nullptr);
+
+            m_percent.push_back({j, indicator::val_type(ind.m_total_p.index()),
+                                 ind.m_total_offset, has_offset, ind.m_total_val,
+                                 m_levels_p.size(), ind.m_levels_p.size()});
+            m_levels_p.insert(m_levels_p.end(), ind.m_levels_p.begin(), ind.m_levels_p.end());
+        }
+    }
+
+    // empty groups start where the next one does
+    m_group[indicator::BOOL + 1] = n;
+    for (int t = indicator::BOOL; t >= 0; --t) {
+        m_group[t] = std::min(m_group[t], m_group[t + 1]);
+    }
+}
+
+void engine::add_spans(span_set &spans) const
+{
+    for (int t = indicator::INT; t <= indicator::BOOL; ++t) {
+        for (size_t i = m_group[t]; i < m_group[t + 1]; ++i) {
+            spans.add(m_offset[i], value_size(indicator::val_type(t)));
+        }
+    }
+
+    for (const auto &p: m_percent) {
+        if (p.has_offset) spans.add(p.offset, value_size(p.type));
+    }
+}
+
+void engine::relocate(const snapshot &snap)
+{
+    for (auto &o: m_offset) o = snap.local(o);
+
+    for (auto &p: m_percent) {
+        if (p.has_offset) p.offset = snap.local(p.offset);
+    }
+}
+
+void engine::set_time(int64_t t_ns, int64_t latency_ns)
+{
+    m_t = t_ns * 1e-9;
+    m_latency = latency_ns * 1e-9;
+}
+
+template <typename T>
+void engine::load(indicator::val_type t, const uint8_t *base)
+{
+    for (size_t i = m_group[t]; i < m_group[t + 1]; ++i) {
+        T v;
+
+        std::memcpy(&v, base + m_offset[i], sizeof(v));
+        m_value[i] = double(v);
+    }
+}
+
+void engine::update_percent(const uint8_t *base)
+{
+    for (auto &p: m_percent) {
+        if (p.has_offset) {
+            const uint8_t *a = base + p.offset;
+
+            switch (p.type) {
+            case indicator::INT:    p.total = read<int>(a);     break;
+            case indicator::LONG:   p.total = read<long>(a);    break;
+            case indicator::FLOAT:  p.total = read<float>(a);   break;
+            case indicator::DOUBLE: p.total = read<double>(a);  break;
+            default:                                            break;
+            }
+        }
+
+        double *levels = &m_levels[p.i * m_stride];
+
+        for (size_t k = 0; k < p.count; ++k) {
+            levels[k] = m_levels_p[p.first + k] * p.total;
+        }
+    }
+}
+
+// Newton's form of the polynomial through the last two or three values,
+// evaluated ahead of the newest one. Values evaluated again are projected
+// the same as the first time, from the same history.
+void engine::predict(bool fresh)
+{
+    for (auto &p: m_predict) {
+        if (fresh || p.n == 0) {
+            p.v[2] = p.v[1];
+            p.v[1] = p.v[0];
+            p.v[0] = m_value[p.i];
+            p.t[2] = p.t[1];
+            p.t[1] = p.t[0];
+            p.t[0] = m_t;
+            if (p.n < 3) ++p.n;
+        }
+
+        const double h = p.ahead < 0? m_latency : p.ahead;
+        const double d1 = p.t[0] - p.t[1];
+
+        if (p.n < 2 || h <= 0 || d1 <= 0) continue;
+
+        const double s1 = (p.v[0] - p.v[1]) / d1;
+        double v = p.v[0] + s1 * h;
+
+        if (p.order > 1 && p.n == 3 && p.t[1] > p.t[2]) {
+            const double s2 = (p.v[1] - p.v[2]) / (p.t[1] - p.t[2]);
+
+            v += (s1 - s2) / (p.t[0] - p.t[2]) * h * (h + d1);
+        }
+        m_value[p.i] = v;
+    }
+}
+
+// Going down, a level is left only when the value is below it by more than
+// the band: the levels reached are then counted again as if the value was
+// that much higher. Any change waits until the current state has been shown
+// for its hold time.
+void engine::settle()
+{
+    const size_t row = m_stride + 1;
+
+    m_holding = false;
+
+    for (auto &s: m_settle) {
+        const uint32_t c = m_count[s.i];
+        uint32_t next = c;
+
+        if (c < s.shown && s.band > 0) {
+            const double v = m_value[s.i] + s.band;
+            const double *levels = &m_levels[s.i * m_stride];
+
+            next = std::min<uint32_t>(s.shown, std::count_if(levels, levels + m_stride,
+                                                             [v](double l) { return l <= v; }));
+        }
+
+        if (next != s.shown) {
+            if (m_t - s.since >= s.hold[m_on[s.i * row + s.shown]]) {
+                s.shown = next;
+                s.since = m_t;
+            } else {
+                next = s.shown;
+                m_holding = true;
+            }
+        }
+
+        if (c != s.last && next != c) {
+            ++m_suppressed;
+            moza::metrics->changes_suppressed.add();
+        }
+        s.last = c;
+        m_count[s.i] = next;
+    }
+}
+
+// Levels are sorted, so the number of them not above the value is what
+// upper_bound would find. They are counted two at a time by SIMD compares,
+// each giving -1 for true. S is the stride if known at compile time.
+template <size_t S>
+void engine::count()
+{
+    const size_t stride = S? S : m_stride;
+    const size_t n = m_n.size();
+
+    for (size_t i = 0; i < n; ++i) {
+        const v2df v = {m_value[i], m_value[i]};
+        const double *levels = &m_levels[i * stride];
+        v2di c = {0, 0};
+
+        for (size_t k = 0; k < stride; k += 2) {
+            v2df l;
+
+            std::memcpy(&l, levels + k, sizeof(l));
+            c -= (l <= v);
+        }
+        m_count[i] = c[0] + c[1];
+    }
+}
+
+void engine::evaluate(const uint8_t *base, uint32_t &mask, std::vector<moza::color_n> &colors,
+                      bool fresh)
+{
+    load<int>(indicator::INT, base);
+    load<long>(indicator::LONG, base);
+    load<float>(indicator::FLOAT, base);
+    load<double>(indicator::DOUBLE, base);
+    load<uint8_t>(indicator::BOOL, base);
+
+    // bools are loaded as the byte, anything but 0 is true
+    for (size_t i = m_group[indicator::BOOL]; i < m_group[indicator::BOOL + 1]; ++i) {
+        m_value[i] = (m_value[i] != 0.0);
+    }
+
+    if (!m_predict.empty()) predict(fresh);
+    update_percent(base);
+
+    switch (m_stride) {
+    case 4:     count<4>(); break;
+    case 8:     count<8>(); break;
+    default:    count<0>(); break;
+    }
+
+    if (!m_settle.empty()) settle();
+
+    const size_t n = m_n.size();
+    const size_t row = m_stride + 1;
+    size_t j = 0;
+
+    mask = 0;
+
+    // written unconditionally, kept only if lit and multicolor
+    for (size_t i = 0; i < n; ++i) {
+        const size_t k = i * row + m_count[i];
+        const uint32_t on = m_on[k];
+
+        mask |= on << m_n[i];
+        m_out[j] = std::make_pair(m_n[i], m_colors[k]);
+        j += on & m_multicolor[i];
+    }
+    colors.assign(m_out.begin(), m_out.begin() + j);
+}
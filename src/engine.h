@@ -0,0 +1,122 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include <rgb.h>
+#include <proto.h>
+#include <stats.h>
+#include "indicator.h"
+#include "spans.h"
+#include "snapshot.h"
+
+// The indicators of one LED set compiled into flat tables, evaluated all at
+// once each cycle. Indicators are grouped by their value type, so that the
+// values are loaded by homogeneous loops, and the levels of each indicator
+// are padded to the same width, so that finding how many of them are passed
+// is a plain count of comparisons instead of a search.
+class engine {
+public:
+    explicit engine(const std::vector<indicator> &indicators);
+
+    // the mask of lit LEDs and the colors of the lit multicolor ones; fresh
+    // is false for values evaluated before, again, like after idle or for a
+    // hold time, which predictions don't take as a new sample
+    void evaluate(const uint8_t *base, uint32_t &mask, std::vector<moza::color_n> &colors,
+                  bool fresh = true);
+
+    size_t size() const { return m_n.size(); }
+
+    // changes in the levels reached that weren't shown, because of
+    // hysteresis or hold times
+    uint64_t suppressed() const { return m_suppressed; }
+
+    // if a change is waiting for a hold time, to be shown by a later
+    // evaluation even of the same values
+    bool holding() const { return m_holding; }
+
+    // the telemetry bytes it reads
+    void add_spans(span_set &spans) const;
+
+    // read from the snapshot from now on, instead of the whole telemetry
+    void relocate(const snapshot &snap);
+
+    // when the values to be evaluated next were taken, and how long it takes
+    // from then until the LEDs show them; predicted values are projected that
+    // far ahead, unless they have a time of their own; hold times are
+    // counted by it too
+    void set_time(int64_t t_ns, int64_t latency_ns);
+
+private:
+    template <typename T>
+    void load(indicator::val_type t, const uint8_t *base);
+
+    void update_percent(const uint8_t *base);
+    void predict(bool fresh);
+    void settle();
+
+    template <size_t S>
+    void count();
+
+    // indicators of type t are [m_group[t], m_group[t + 1])
+    std::array<size_t, indicator::BOOL + 2> m_group;
+
+    std::vector<uint32_t> m_offset;
+    std::vector<uint8_t> m_n;
+    std::vector<uint8_t> m_multicolor;
+
+    // per cycle
+    std::vector<double> m_value;
+    std::vector<uint32_t> m_count;              // levels reached
+    std::vector<moza::color_n> m_out;
+
+    size_t m_stride;                            // levels per indicator
+    std::vector<double> m_levels;               // unused ones never reached
+    // by the number of levels reached, m_stride + 1 per indicator
+    std::vector<uint8_t> m_on;
+    std::vector<RGB> m_colors;
+
+    // levels given in percent of a total, recalculated every cycle
+    struct percent {
+        size_t i;                               // indicator
+        indicator::val_type type;
+        uint32_t offset;
+        bool has_offset;
+        double total;
+        size_t first;                           // in m_levels_p
+        size_t count;
+    };
+    std::vector<percent> m_percent;
+    std::vector<double> m_levels_p;
+
+    // values extrapolated from the last ones, newest first
+    struct predictor {
+        size_t i;                               // indicator
+        uint8_t order;
+        double ahead;                           // s, negative for m_latency
+        uint8_t n;                              // values so far, up to 3
+        double v[3];
+        double t[3];
+    };
+    std::vector<predictor> m_predict;
+    double m_t = 0;                             // s
+    double m_latency = 0;                       // s
+
+    // levels reached as shown, changing only past the hysteresis band and
+    // after the hold time
+    struct settling {
+        size_t i;                               // indicator
+        double band;
+        double hold[2];                         // s, by off and on
+        uint32_t shown;
+        uint32_t last;                          // as evaluated the last time
+        double since;                           // s, when shown changed
+    };
+    std::vector<settling> m_settle;
+    uint64_t m_suppressed = 0;
+    bool m_holding = false;
+};
+
+#endif // ENGINE_H
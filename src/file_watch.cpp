@@ -0,0 +1,50 @@
+#include "file_watch.h"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/inotify.h>
+
+file_watch::file_watch(const std::string &fname)
+    : m_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+    const std::filesystem::path p = std::filesystem::absolute(fname);
+
+    if (m_fd < 0 || inotify_add_watch(m_fd, p.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        const std::string err = std::strerror(errno);
+
+        if (m_fd >= 0) close(m_fd);
+        throw std::runtime_error("inotify " + p.parent_path().string() + ": " + err);
+    }
+    m_name = p.filename();
+}
+
+file_watch::~file_watch()
+{
+    close(m_fd);
+}
+
+bool file_watch::changed()
+{
+    alignas(inotify_event) char buf[4096];
+    bool ours = false;
+
+    for (;;) {
+        const ssize_t n = read(m_fd, buf, sizeof(buf));
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (ssize_t i = 0; i < n;) {
+            const auto *e = reinterpret_cast<const inotify_event*>(buf + i);
+
+            if (e->len && m_name == e->name) ours = true;
+            i += sizeof(inotify_event) + e->len;
+        }
+    }
+    return ours;
+}
@@ -0,0 +1,25 @@
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+
+#include <string>
+
+// Tells if a file has been written or replaced since the last check. The
+// directory is watched rather than the file itself, as editors often save by
+// writing a new file and renaming it over the old one.
+class file_watch {
+public:
+    explicit file_watch(const std::string &fname);
+    ~file_watch();
+
+    file_watch(const file_watch&) = delete;
+    file_watch& operator=(const file_watch&) = delete;
+
+    // never blocks
+    bool changed();
+
+private:
+    int m_fd;
+    std::string m_name;
+};
+
+#endif // FILE_WATCH_H
@@ -0,0 +1,151 @@
+#include "frame_sync.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <time.h>
+
+namespace {
+
+constexpr int64_t NS = 1000000000;
+constexpr int64_t US = 1000;
+
+constexpr int64_t poll_ns = 100 * US;   // between reads once done spinning
+constexpr int64_t max_spin_ns = 200 * US;
+
+int64_t now_ns()
+{
+    timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * NS + t.tv_nsec;
+}
+
+// a signal only ends it early, it's polled again anyway
+void sleep_until(int64_t t)
+{
+    const timespec ts = {time_t(t / NS), long(t % NS)};
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+}
+
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+} // namespace
+
+frame_sync::frame_sync(unsigned int timeout_ms)
+    : m_timeout(int64_t(std::max(timeout_ms, 1u)) * 1000000)
+{
+}
+
+bool frame_sync::wait(const snapshot &snap, const volatile uint8_t *src, unsigned int n)
+{
+    const uint64_t last = snap.taken_counter();
+    const int64_t start = now_ns();
+    const int64_t give_up = start + std::max(m_timeout, 2 * m_period) * std::max(n, 1u);
+
+    ++m_stats.polls;
+    // written while the last one was being evaluated, when it was seen isn't
+    // known well enough to learn from
+    if (snap.counter(src) != last) {
+        seen_late(start);
+        ++m_stats.frames;
+        moza::metrics->game_frames.add();
+        return true;
+    }
+
+    // woken up early by a few times the jitter, spinning through that much
+    int64_t spin = 0;
+
+    if (m_period > 0) {
+        const int64_t margin = std::clamp(4 * m_jitter, 50 * US, m_period / 4);
+        int64_t due = m_last_at + m_period;
+
+        // one or more updates missed, the next one on the same grid
+        if (due < start) due += ((start - due) / m_period + 1) * m_period;
+        if (due - margin > start) sleep_until(std::min(due - margin, give_up));
+        spin = std::min(2 * margin, max_spin_ns);
+    }
+
+    const int64_t spin_until = now_ns() + spin;
+
+    for (bool watched = false;; watched = true) {
+        const int64_t t = now_ns();
+
+        ++m_stats.polls;
+        if (snap.counter(src) != last) {
+            learn(t, watched);
+            ++m_stats.frames;
+            moza::metrics->game_frames.add();
+            return true;
+        }
+        if (t >= give_up) {
+            ++m_stats.timeouts;
+            return false;
+        }
+        if (t < spin_until) {
+            cpu_relax();
+        } else {
+            sleep_until(std::min(t + poll_ns, give_up));
+        }
+    }
+}
+
+// averaged over the last 8 or so; a gap of a few periods is that many
+// updates, one of them seen, and a longer one a pause that tells nothing.
+// Only on the first look after sleeping can updates have been missed: one
+// found while watching the counter is the first since the last, however
+// long it took, so a period learned wrong at first is unlearned
+void frame_sync::learn(int64_t t, bool watched)
+{
+    int64_t dt = t - m_last_at;
+
+    m_last_at = t;
+    if (dt <= 0 || dt >= NS) return;
+
+    if (m_period > 0) {
+        const int64_t k = watched? 1 : (dt + m_period / 2) / m_period;
+
+        if (k > 1) {
+            m_stats.missed += k - 1;
+            moza::metrics->game_frames_missed.add(k - 1);
+            dt /= k;
+        }
+
+        // a hitch of the game moves it only so far
+        const int64_t err = std::clamp(dt - m_period, -m_period / 2, m_period);
+
+        m_period += err / 8;
+        m_jitter += (std::abs(err) - m_jitter) / 8;
+    } else {
+        m_period = dt;
+    }
+}
+
+// an update that was there before waiting for it: it came when it was due,
+// at the latest point of the grid of updates before t, and the ones since
+// the last seen were missed; without a period, t is the best guess there is
+void frame_sync::seen_late(int64_t t)
+{
+    const int64_t dt = t - m_last_at;
+
+    if (m_period <= 0 || dt >= NS) {
+        m_last_at = t;
+        return;
+    }
+
+    // or a little early, by the jitter
+    const int64_t k = std::max<int64_t>(dt / m_period, 1);
+
+    if (k > 1) {
+        m_stats.missed += k - 1;
+        moza::metrics->game_frames_missed.add(k - 1);
+    }
+    m_last_at += k * m_period;
+}
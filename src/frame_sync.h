@@ -0,0 +1,47 @@
+#ifndef FRAME_SYNC_H
+#define FRAME_SYNC_H
+
+#include <cstdint>
+
+#include "snapshot.h"
+
+// Waits for the game to write its next update, told by the frame counter
+// changing, so that each update is evaluated once and as soon as it's there
+// instead of whenever a timer says. The time between updates is learned:
+// most of it is slept through, then the counter is watched from a little
+// before the next one is due, spinning for a short while and polling in
+// short sleeps after that. How early, and how long it spins, follows how
+// much the updates jitter.
+class frame_sync {
+public:
+    struct counters {
+        uint64_t frames = 0;            // updates seen
+        uint64_t missed = 0;            // written and overwritten in between
+        uint64_t timeouts = 0;
+        uint64_t polls = 0;             // reads of the counter
+    };
+
+    // gives up after timeout_ms, or twice the time between updates if longer
+    explicit frame_sync(unsigned int timeout_ms);
+
+    // true once the counter differs from the one of the last snapshot, false
+    // if it hasn't changed for n timeouts
+    bool wait(const snapshot &snap, const volatile uint8_t *src, unsigned int n = 1);
+
+    // the learned time between updates, 0 until there have been two
+    int64_t period_ns() const { return m_period; }
+    const counters &stats() const { return m_stats; }
+
+private:
+    void learn(int64_t t, bool watched);
+    void seen_late(int64_t t);
+
+    int64_t m_timeout;                  // ns
+    int64_t m_last_at = 0;              // when the last update was seen
+    int64_t m_period = 0;               // ns, averaged
+    int64_t m_jitter = 0;               // ns, mean deviation from m_period
+
+    counters m_stats;
+};
+
+#endif // FRAME_SYNC_H
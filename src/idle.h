@@ -0,0 +1,46 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <algorithm>
+
+// Whether the game is being played, and how many periods to wait between
+// checks if not: one at first, doubling with every inactive check up to a
+// ceiling. Back to every period as soon as it's active again.
+class idle_state {
+public:
+    explicit idle_state(unsigned int max_periods)
+        : m_max(std::max(max_periods, 1u)) {}
+
+    // true if it has just become idle
+    bool inactive()
+    {
+        const bool entered = !m_idle;
+
+        m_idle = true;
+        m_periods = entered? 1 : std::min(2 * m_periods, m_max);
+        if (entered) ++m_entered;
+        return entered;
+    }
+
+    // true if it has just stopped being idle
+    bool active()
+    {
+        const bool left = m_idle;
+
+        m_idle = false;
+        m_periods = 1;
+        return left;
+    }
+
+    bool idle() const { return m_idle; }
+    unsigned int periods() const { return m_periods; }
+    unsigned long entered() const { return m_entered; }
+
+private:
+    unsigned int m_max;
+    unsigned int m_periods = 1;
+    bool m_idle = false;
+    unsigned long m_entered = 0;
+};
+
+#endif // IDLE_H
@@ -3,6 +3,8 @@
 #include <stdexcept>
 #include <libconfig.h++>
 
+#include <proto.h>
+
 namespace {
 
 RGB rgb_from_setting(const libconfig::Setting& s)
@@ -17,10 +19,19 @@ RGB rgb_from_setting(const libconfig::Setting& s)
     }
 }
 
+// set for the LED itself, or for all those of its value
+const libconfig::Setting *own_or_value(const libconfig::Setting &s, const libconfig::Setting &v,
+                                       const char *name)
+{
+    if (s.exists(name)) return &s.lookup(name);
+    if (v.exists(name)) return &v.lookup(name);
+    return nullptr;
+}
+
 } // namespace
 
 indicator::indicator(const libconfig::Setting &s, const volatile uint8_t *baseaddr)
-    : m_total_p((int*)nullptr), has_total(false)
+    : m_total_offset(0), m_total_p((int*)nullptr), has_total(false)
 {
     const libconfig::Setting *v = nullptr;
     const libconfig::Setting *r = &s;
@@ -38,7 +49,12 @@ indicator::indicator(const libconfig::Setting &s, const volatile uint8_t *basead
         throw std::runtime_error("value clause not found for " + s.getPath());
     }
 
-    const volatile uint8_t *const p = baseaddr + (unsigned int)(v->lookup("offset"));
+    const int offset = v->lookup("offset");
+
+    if (offset < 0) throw std::runtime_error("negative offset at " + v->getPath());
+    m_offset = offset;
+
+    const volatile uint8_t *const p = baseaddr + m_offset;
 
     if (s.exists("inv")) {
         const auto &i = s.lookup("inv");
@@ -56,7 +72,13 @@ indicator::indicator(const libconfig::Setting &s, const volatile uint8_t *basead
         const auto &total_s = v->lookup("total");
         if (total_s.isAggregate()) {
             const std::string t = total_s.lookup("type");
-            const volatile uint8_t *p = baseaddr + (unsigned long)(total_s.lookup("offset"));
+
+            const int total_offset = total_s.lookup("offset");
+
+            if (total_offset < 0) throw std::runtime_error("negative offset at " + total_s.getPath());
+            m_total_offset = total_offset;
+
+            const volatile uint8_t *p = baseaddr + m_total_offset;
 
             if (t == "float")           m_total_p = (float*)p;
             else if (t == "double")     m_total_p = (double*)p;
@@ -114,11 +136,52 @@ indicator::indicator(const libconfig::Setting &s, const volatile uint8_t *basead
         m_p = (bool*)p;
     }
 
+    if (v->exists("predict")) {
+        const auto &pr = v->lookup("predict");
+        int order = 1;
+        double ms;
+
+        pr.lookupValue("order", order);
+        if (order < 1 || order > 2) {
+            throw std::runtime_error("prediction order must be 1 or 2 at " + pr.getPath());
+        }
+        if (m_p.index() == BOOL) {
+            throw std::runtime_error("a bool value can't be predicted at " + pr.getPath());
+        }
+        m_predict = order;
+        if (pr.lookupValue("ahead_ms", ms)) m_predict_ahead = ms * 0.001;
+    }
+
+    if (const auto *h = own_or_value(s, *v, "hysteresis")) {
+        if (m_p.index() == BOOL) {
+            throw std::runtime_error("hysteresis of a bool value at " + h->getPath());
+        }
+        m_hysteresis = double(*h);
+    }
+
+    if (const auto *h = own_or_value(s, *v, "hold_ms")) {
+        // the same for both, or how long on and how long off
+        if (h->isAggregate()) {
+            if (h->getLength() != 2) {
+                throw std::runtime_error("hold_ms must be one time or two at " + h->getPath());
+            }
+            m_hold[1] = double((*h)[0]) * 0.001;
+            m_hold[0] = double((*h)[1]) * 0.001;
+        } else {
+            m_hold[0] = m_hold[1] = double(*h) * 0.001;
+        }
+    }
+
     update();
 
     std::fill_n(std::back_inserter(m_inv), m_levels.size() - m_inv.size(), false);
 
-    m_n = int(s.lookup("n")) - 1;
+    const int n = s.lookup("n");
+
+    if (n < 1 || n > moza::max_leds) {
+        throw std::runtime_error("LED number out of range at " + s.getPath());
+    }
+    m_n = n - 1;
 
     const auto &c = s.lookup("color");
     if (c.isAggregate()) {
@@ -27,6 +27,11 @@ public:
     RGB color() const;
 
 private:
+    friend class engine;
+
+    unsigned int m_offset;
+    unsigned int m_total_offset;
+
     value_p m_p;
     value_t m_val;
     value_p m_total_p;
@@ -41,6 +46,16 @@ private:
     std::vector<double> m_levels;
     std::vector<double> m_levels_p;
     std::vector<bool> m_inv;
+
+    // extrapolate the value to when it's shown: 0 for not, 1 linearly, 2 by
+    // a parabola; by how long in seconds, negative for the measured latency
+    uint8_t m_predict = 0;
+    double m_predict_ahead = -1;
+
+    // a value has to go this much below a level to be off it again, and a
+    // change is shown at least this long in s, by off and on
+    double m_hysteresis = 0;
+    double m_hold[2] = {0, 0};
 };
 
 #endif // INDICATOR_H
@@ -0,0 +1,159 @@
+#include "leds_config.h"
+#include <stdexcept>
+
+#include "indicator.h"
+#include "spans.h"
+
+namespace {
+
+using libconfig::Setting;
+
+// each entry of the devices list, or the root for the only one
+std::vector<const Setting*> device_settings(const libconfig::Config &cfg)
+{
+    std::vector<const Setting*> v;
+
+    if (!cfg.exists("devices")) {
+        v.push_back(&cfg.getRoot());
+        return v;
+    }
+
+    for (const Setting &d: cfg.lookup("devices")) v.push_back(&d);
+    if (v.empty()) throw std::runtime_error("config: the devices list is empty");
+    return v;
+}
+
+} // namespace
+
+leds_config::leds_config(const libconfig::Config &cfg,
+                         const std::vector<std::vector<moza::color_n> > &idle_colors,
+                         const volatile uint8_t *base, size_t size)
+    : snap(span_set(16))
+{
+    for (const auto &s: cfg.lookup("active")) {
+        int offset;
+        bool inv = false;
+
+        if (s.lookupValue("offset", offset)) {
+            if (offset < 0) throw std::runtime_error("config: negative offset at " + s.getPath());
+            s.lookupValue("inv", inv);
+            activity_flags.push_back(std::make_pair(uint32_t(offset), inv));
+        }
+    }
+
+    const auto settings = device_settings(cfg);
+
+    devices.resize(settings.size());
+
+    for (size_t k = 0; k < settings.size(); ++k) {
+        const Setting &ds = *settings[k];
+        device &d = devices[k];
+
+        std::vector<indicator> rpm_indicators;
+
+        if (ds.exists("rpm")) {
+            for (const Setting &c: ds.lookup("rpm.leds")) {
+                indicator i(c, base);
+
+                rpm_indicators.push_back(i);
+                d.rpm_base.push_back(std::make_pair(i.n(), i.color()));
+            }
+        }
+
+        // new colors for the buttons used for telemetry, the rest as they were
+        std::vector<indicator> btn_indicators;
+        uint32_t used = 0;
+
+        if (ds.exists("button_leds")) {
+            d.btn_base = idle_colors.at(k);
+            for (const Setting &c: ds.lookup("button_leds")) {
+                indicator i(c, base);
+
+                btn_indicators.push_back(i);
+                d.btn_base.at(i.n()) = std::make_pair(i.n(), i.color());
+                used |= 1 << i.n();
+            }
+            d.unused = 0x3fff & ~used;
+        }
+
+        d.rpm_engine = engine(rpm_indicators);
+        d.btn_engine = engine(btn_indicators);
+    }
+
+    span_set spans(16);
+
+    for (const auto &p: activity_flags) spans.add(p.first, 1);
+    for (const auto &d: devices) {
+        d.btn_engine.add_spans(spans);
+        d.rpm_engine.add_spans(spans);
+    }
+
+    if (spans.end() > size) {
+        throw std::runtime_error("config: offsets up to byte " + std::to_string(spans.end()) +
+                                 ", the telemetry has " + std::to_string(size));
+    }
+    snap = snapshot(spans);
+
+    if (cfg.exists("frame_counter")) {
+        const auto &c = cfg.lookup("frame_counter");
+        std::string t = "int";
+
+        c.lookupValue("type", t);
+        c.lookupValue("sync", sync);
+
+        const int offset = c.lookup("offset");
+        const uint32_t n = (t == "long" || t == "double")? 8 : 4;
+
+        if (offset < 0 || uint64_t(offset) + n > size) {
+            throw std::runtime_error("config: frame_counter.offset " + std::to_string(offset) +
+                                     " is out of the telemetry's " + std::to_string(size) + " bytes");
+        }
+        snap.set_counter(offset, n);
+    }
+
+    for (auto &d: devices) {
+        d.btn_engine.relocate(snap);
+        d.rpm_engine.relocate(snap);
+    }
+    for (auto &p: activity_flags) p.first = snap.local(p.first);
+}
+
+void leds_config::read(const std::string &fname, libconfig::Config &cfg)
+{
+    using namespace libconfig;
+
+    cfg.setAutoConvert(true);
+
+    try {
+        cfg.readFile(fname);
+    } catch (const ParseException &ex) {
+        throw std::runtime_error(std::string("config parse error ") + ex.getFile() + ":" +
+                                 std::to_string(ex.getLine()) + " - " + ex.getError());
+    } catch (const FileIOException &) {
+        throw std::runtime_error("can't read " + fname);
+    }
+}
+
+std::vector<device_spec> leds_config::read_devices(const libconfig::Config &cfg)
+{
+    std::vector<device_spec> specs;
+
+    for (const Setting *ds: device_settings(cfg)) {
+        device_spec s;
+
+        // unnamed ones by their place in the list, the only one has no name
+        if (!ds->lookupValue("name", s.name) && !ds->isRoot()) {
+            s.name = std::to_string(specs.size() + 1);
+        }
+        ds->lookupValue("port", s.port);
+        s.has_rpm = ds->exists("rpm");
+        s.has_buttons = ds->exists("button_leds");
+
+        if (!s.has_rpm && !s.has_buttons) {
+            throw std::runtime_error("config: no rpm or button_leds for " +
+                                     (s.name.empty()? std::string("the device") : "device " + s.name));
+        }
+        specs.push_back(s);
+    }
+    return specs;
+}
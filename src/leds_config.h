@@ -0,0 +1,71 @@
+#ifndef LEDS_CONFIG_H
+#define LEDS_CONFIG_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <libconfig.h++>
+
+#include <proto.h>
+#include "engine.h"
+#include "snapshot.h"
+
+// A device as the config declares it, what needs a restart to change. It's
+// either one of the devices list, or the whole config if there's no list.
+struct device_spec {
+    std::string name;
+    std::string port;                   // a path, or part of a name in /dev/serial/by-id
+    bool has_rpm = false;
+    bool has_buttons = false;
+
+    bool operator==(const device_spec &o) const
+    {
+        return name == o.name && port == o.port &&
+               has_rpm == o.has_rpm && has_buttons == o.has_buttons;
+    }
+    bool operator!=(const device_spec &o) const { return !(*this == o); }
+};
+
+// The part of the config that says what the LEDs show, compiled and ready
+// to be evaluated. It can be built anew from a changed config file while
+// the old one is in use, then swapped for it between cycles.
+struct leds_config {
+    // the LEDs of one device
+    struct device {
+        engine rpm_engine{std::vector<indicator>()};
+        engine btn_engine{std::vector<indicator>()};
+
+        // what the LEDs are set to show, lit or not: all 14 buttons, indexed by n
+        std::vector<moza::color_n> rpm_base;
+        std::vector<moza::color_n> btn_base;
+        uint32_t unused = 0;            // buttons not used by indicators, always lit
+    };
+
+    // idle_colors are what the buttons of each device showed before,
+    // indexed by n; base is what the offsets are from, any buffer of the
+    // telemetry's size will do; an offset past size is a config error
+    leds_config(const libconfig::Config &cfg,
+                const std::vector<std::vector<moza::color_n> > &idle_colors,
+                const volatile uint8_t *base, size_t size);
+
+    // throws std::runtime_error with the reason if the file can't be read
+    static void read(const std::string &fname, libconfig::Config &cfg);
+
+    // in the order of the devices list
+    static std::vector<device_spec> read_devices(const libconfig::Config &cfg);
+
+    // telemetry offsets in the snapshot, and if the flag means inactive
+    std::vector<std::pair<uint32_t, bool> > activity_flags;
+
+    std::vector<device> devices;
+
+    // everything is evaluated on a copy of just the telemetry in use, one
+    // for all the devices
+    snapshot snap;
+
+    // evaluate each update of the frame counter as it comes, not on a timer
+    bool sync = false;
+};
+
+#endif // LEDS_CONFIG_H
@@ -1,35 +1,58 @@
 #include <iostream>
+#include <iomanip>
+#include <fstream>
 #include <filesystem>
 #include <algorithm>
+#include <numeric>
 #include <cstring>
+#include <limits>
+#include <cmath>
+
+#include <memory>
+#include <chrono>
+#include <future>
+#include <csignal>
 
 #include <unistd.h>
 
-#include <libserial/SerialPort.h>
 #include <libconfig.h++>
 
 #include <getopt.h>
 #include <basedir.h>
 #include <basedir_fs.h>
-#include <sys/mman.h>
-#include <sys/stat.h>        /* For mode constants */
-#include <fcntl.h>           /* For O_* constants */
 
 #include <rgb.h>
 #include <proto.h>
-#include "indicator.h"
+#include <transport.h>
+#include <shadow.h>
+#include <writer.h>
+#include <trace.h>
+#include "recorder.h"
+#include "scheduler.h"
+#include "frame_sync.h"
+#include "telemetry_source.h"
+#include "idle.h"
+#include "leds_config.h"
+#include "file_watch.h"
+#include "stats_file.h"
+#include "realtime.h"
 
 using namespace std;
 namespace fs = std::filesystem;
 
 namespace {
 
-LibSerial::SerialPort port;
-
-void init_port()
+// a path, or the first device in /dev/serial/by-id with that in its name,
+// the wheel base if nothing is given
+void init_port(moza::transport &port, const string &path)
 {
+    if (!path.empty() && path[0] == '/') {
+        port.open(path);
+        return;
+    }
+
     fs::directory_entry dir("/dev/serial/by-id");
-    const string base_serial_filename = "Base";
+    const string serial_filename = path.empty()? "Base" : path;
 
     if (!dir.exists()) {
         throw runtime_error("Serial path doesn't exist, connect the wheel.");
@@ -37,20 +60,57 @@ void init_port()
 
     auto const& p = find_if(fs::directory_iterator(dir), fs::directory_iterator(),
                             [&](auto const &f) {
-                                return f.path().filename().string().find(base_serial_filename)
+                                return f.path().filename().string().find(serial_filename)
                                         != string::npos;
                             });
 
     if (p != fs::directory_iterator()) {
         cout << p->path() << endl;
     } else {
-        throw runtime_error("No serial device.");
+        throw runtime_error("No serial device matching \"" + serial_filename + "\".");
     }
 
-    port.Open(p->path());
+    port.open(p->path());
 }
 
 bool no_wheel = false;
+bool show_stats = false;
+string port_path;
+string record_fname;
+string replay_fname;
+double replay_speed = 1;
+
+volatile sig_atomic_t stop = 0;
+volatile sig_atomic_t reload = 0;
+volatile sig_atomic_t dump_trace = 0;
+
+void on_signal(int)
+{
+    stop = 1;
+}
+
+void on_reload(int)
+{
+    reload = 1;
+}
+
+void on_dump(int)
+{
+    dump_trace = 1;
+}
+
+// the colors of base, those in over replacing the ones of the same LEDs
+void overlay(const vector<moza::color_n> &base, const vector<moza::color_n> &over,
+             vector<moza::color_n> &out)
+{
+    out = base;
+    for (const auto &c: over) {
+        auto p = find_if(out.begin(), out.end(), [&](const auto &b) { return b.first == c.first; });
+
+        if (p != out.end()) *p = c;
+        else                out.push_back(c);
+    }
+}
 
 void check_opts(int argc, char* argv[])
 {
@@ -59,31 +119,63 @@ void check_opts(int argc, char* argv[])
     for (;;) {
         int option_index = 0;
         static struct option long_options[] = {
-            {"debug", no_argument, 0, 0},
-            {"no-wheel", no_argument, 0, 0},
-            {"version", no_argument, 0, 0}
+            {"debug", no_argument, 0, 'd'},
+            {"no-wheel", no_argument, 0, 'n'},
+            {"version", no_argument, 0, 'V'},
+            {"port", required_argument, 0, 'p'},
+            {"record", required_argument, 0, 'r'},
+            {"replay", required_argument, 0, 'R'},
+            {"speed", required_argument, 0, 's'},
+            {"stats", no_argument, 0, 'S'},
+            {0, 0, 0, 0}
         };
 
-        optc = getopt_long(argc, argv, "dnV", long_options, &option_index);
+        optc = getopt_long(argc, argv, "dnVp:r:R:s:S", long_options, &option_index);
         if (optc == -1 ) break;
 
         switch (optc) {
-            case 0:
             case 'd':
                 moza::debug = true;
                 break;
-            case 1:
             case 'n':
                 no_wheel = true;
                 break;
-            case 2:
             case 'V':
                 cerr << "leds4sim version 0.1" << endl;
                 exit(EXIT_SUCCESS);
+            case 'p':
+                port_path = optarg;
+                break;
+            case 'r':
+                record_fname = optarg;
+                break;
+            case 'R':
+                replay_fname = optarg;
+                break;
+            case 's': {
+                char *end;
+
+                replay_speed = strtod(optarg, &end);
+                // 0 is as fast as possible
+                if (end == optarg || *end || !(replay_speed >= 0) || isinf(replay_speed)) {
+                    cerr << "bad speed: " << optarg << endl;
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 'S':
+                show_stats = true;
+                break;
             default:
-                cerr << "Usage: " << argv[0] << " [-d|--debug] [-n|--no-wheel]" << endl;
-                cerr << "\t-d, --debug\tprint serial data" << endl;
+                cerr << "Usage: " << argv[0] << " [-d|--debug] [-n|--no-wheel] [-p|--port device]"
+                     << " [-r|--record file] [-R|--replay file [-s|--speed x]] [-S|--stats]" << endl;
+                cerr << "\t-d, --debug\tprint counters and write the serial trace on exit" << endl;
                 cerr << "\t-n, --no-wheel\tdon't interact with the real device, useful for debugging" << endl;
+                cerr << "\t-p, --port\tuse this serial device instead of looking for the wheel base (the first device)" << endl;
+                cerr << "\t-r, --record\trecord the telemetry used by the config into a file" << endl;
+                cerr << "\t-R, --replay\tread the telemetry from a recording instead of the game" << endl;
+                cerr << "\t-s, --speed\treplay at this times the recorded pace, 0 for as fast as possible" << endl;
+                cerr << "\t-S, --stats\tprint the counters of the running leds4sim and exit" << endl;
                 exit(EXIT_FAILURE);
         }
     }
@@ -106,6 +198,145 @@ string config_name()
     return conf_fname;
 }
 
+// where the button colors read from a device are kept between runs
+string state_name(const string &device)
+{
+    const char *state = getenv("XDG_STATE_HOME");
+    const char *home = getenv("HOME");
+    fs::path dir;
+
+    if (state && *state)    dir = state;
+    else if (home && *home) dir = fs::path(home) / ".local" / "state";
+    else                    return string();
+
+    return (dir / "leds4sim" / (device.empty()? "button_colors" : "button_colors." + device)).string();
+}
+
+// where the counters of the running one (stats) and its serial trace
+// (trace) go
+string runtime_name(const string &what)
+{
+    const char *run = getenv("XDG_RUNTIME_DIR");
+
+    if (run && *run) return (fs::path(run) / ("leds4sim." + what)).string();
+    return "/tmp/leds4sim-" + to_string(getuid()) + "." + what;
+}
+
+void write_trace()
+{
+    const string fname = runtime_name("trace");
+
+    try {
+        moza::wire.dump(fname);
+        cerr << "Serial trace written to " << fname << endl;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+    }
+}
+
+// all count of them or none
+vector<moza::color_n> load_colors(const string &fname, size_t count)
+{
+    vector<moza::color_n> colors;
+    ifstream f(fname);
+    int c;
+
+    while (colors.size() < count && f >> hex >> c) {
+        colors.push_back(make_pair(colors.size(), RGB::from_int(c)));
+    }
+    if (colors.size() != count) colors.clear();
+    return colors;
+}
+
+void save_colors(const string &fname, const vector<moza::color_n> &colors)
+{
+    error_code ec;
+
+    fs::create_directories(fs::path(fname).parent_path(), ec);
+
+    ofstream f(fname);
+
+    for (const auto &c: colors) {
+        const auto [r, g, b] = c.second.rgb();
+
+        f << hex << setw(6) << setfill('0') << (r << 16 | g << 8 | b) << endl;
+    }
+    if (!f) cerr << "can't save the button colors to " << fname << endl;
+}
+
+// real-time scheduling and memory, none unless asked for
+struct rt_options {
+    int priority = 0;                   // SCHED_FIFO of the loop, 0 for none
+    vector<int> cpus;
+    int serial_priority = -1;           // of the writer threads, the loop's if not set
+    vector<int> serial_cpus;
+    bool lock_memory = false;
+    bool prefault = false;
+};
+
+rt_options read_rt(const libconfig::Config &cfg)
+{
+    rt_options rt;
+
+    if (!cfg.exists("realtime")) return rt;
+
+    const auto &c = cfg.lookup("realtime");
+    auto cpus = [&c](const char *name, vector<int> &v) {
+        if (!c.exists(name)) return;
+        for (const auto &n: c.lookup(name)) v.push_back(n);
+    };
+
+    c.lookupValue("priority", rt.priority);
+    cpus("cpus", rt.cpus);
+    c.lookupValue("serial_priority", rt.serial_priority);
+    cpus("serial_cpus", rt.serial_cpus);
+    c.lookupValue("lock_memory", rt.lock_memory);
+    c.lookupValue("prefault", rt.prefault);
+
+    if (rt.serial_priority < 0) rt.serial_priority = rt.priority;
+    if (rt.serial_cpus.empty()) rt.serial_cpus = rt.cpus;
+
+    if (rt.priority < 0 || rt.priority > 99 || rt.serial_priority > 99) {
+        throw runtime_error("realtime priorities must be 0 to 99");
+    }
+    return rt;
+}
+
+// where the telemetry comes from, by itself mmap_file and mmap_size are
+// the shared memory one
+source_options read_source(const libconfig::Config &cfg)
+{
+    source_options s;
+    // the options are unsigned, a negative one would wrap around
+    auto in_range = [](const libconfig::Setting &v, int max) {
+        const int n = v;
+
+        if (n < 1 || n > max) {
+            throw runtime_error("config: " + v.getPath() + " must be 1 to " + to_string(max));
+        }
+        return n;
+    };
+
+    if (!cfg.exists("source")) {
+        s.file = cfg.lookup("mmap_file").c_str();
+        s.size = in_range(cfg.lookup("mmap_size"), numeric_limits<int>::max());
+        return s;
+    }
+
+    const auto &c = cfg.lookup("source");
+
+    c.lookupValue("type", s.type);
+    s.size = in_range(c.lookup("size"), numeric_limits<int>::max());
+    if (s.type == "shm") {
+        s.file = c.lookup("file").c_str();
+    } else {
+        c.lookupValue("address", s.address);
+        s.port = in_range(c.lookup("port"), 65535);
+        if (c.exists("timeout_ms")) s.timeout_ms = in_range(c.lookup("timeout_ms"), numeric_limits<int>::max());
+    }
+    return s;
+}
+
 } // namespace
 
 int main(int argc, char* argv[])
@@ -113,10 +344,25 @@ int main(int argc, char* argv[])
     using namespace libconfig;
 
     check_opts(argc, argv);
-    if (!no_wheel) init_port();
 
-    Config cfg;
-    cfg.setAutoConvert(true);
+    if (show_stats) {
+        try {
+            stats_file::print(runtime_name("stats"), cout);
+        } catch (const exception &e) {
+            cerr << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // counted from the start, for --stats
+    unique_ptr<stats_file> published;
+
+    try {
+        published = make_unique<stats_file>(runtime_name("stats"));
+    } catch (const exception &e) {
+        cerr << e.what() << ", no stats for --stats" << endl;
+    }
 
     const string conf_fname = config_name();
 
@@ -125,132 +371,549 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    Config cfg;
+
     try {
-        cfg.readFile(conf_fname);
-    } catch (const ParseException &ex) {
-        cerr << "config parse error " << ex.getFile() << ":" << ex.getLine()
-             << " - " << ex.getError() << std::endl;
+        leds_config::read(conf_fname, cfg);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
         return EXIT_FAILURE;
     }
 
-    string mmap_fname = cfg.lookup("mmap_file").c_str();
-    int mfd = open(mmap_fname.c_str(), O_RDONLY);
+    vector<device_spec> specs;
+    rt_options rt;
+    source_options sopt;
 
-    if (mfd < 0 && (errno == ENOENT || errno == EINVAL)) {
-        cerr << "Telemetry not found in shared memory, waiting for the game to start (Ctrl+C to cancel)." << endl;
+    try {
+        specs = leds_config::read_devices(cfg);
+        rt = read_rt(cfg);
+        sopt = read_source(cfg);
+    } catch (const SettingException &e) {
+        cerr << "config: " << e.what() << " at " << e.getPath() << endl;
+        return EXIT_FAILURE;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
     }
 
-    while (mfd < 0) {
-        sleep(1);
-        mfd = open(mmap_fname.c_str(), O_RDONLY);
+    // a serial port per device, opened unless there's no wheel
+    moza::transport_options topt;
+    string backend = "native";
+
+    if (cfg.exists("serial")) {
+        const auto &c = cfg.lookup("serial");
+
+        c.lookupValue("backend", backend);
+        c.lookupValue("low_latency", topt.low_latency);
     }
 
-    const volatile uint8_t *const data = (uint8_t*)mmap(NULL, int(cfg.lookup("mmap_size")), PROT_READ, MAP_PRIVATE, mfd, 0);
-    int cycle = cfg.lookup("cycle_ms");
+    vector<unique_ptr<moza::transport> > ports;
+
+    for (const auto &d: specs) {
+        try {
+            ports.push_back(moza::make_transport(backend, topt));
+            if (no_wheel) continue;
+            // the one given on the command line stands for the first device
+            if (ports.size() == 1 && !port_path.empty())    ports.back()->open(port_path);
+            else                                            init_port(*ports.back(), d.port);
+        } catch (const exception &e) {
+            cerr << (d.name.empty()? "" : d.name + ": ") << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+    }
 
-    const auto &activity_parms = cfg.lookup("active");
-    vector<pair<unsigned int, bool> > activity_flags;
+    unique_ptr<replayer> replay;
+    unique_ptr<telemetry_source> src;
+    const volatile uint8_t *data;
 
-    for (const auto &s: activity_parms) {
-        int offset;
-        bool inv = false;
+    if (!replay_fname.empty()) {
+        try {
+            replay = make_unique<replayer>(replay_fname, sopt.size);
+        } catch (const exception &e) {
+            cerr << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+        data = replay->data();
+    } else {
+        try {
+            src = make_source(sopt);
+        } catch (const exception &e) {
+            cerr << e.what() << endl;
+            return EXIT_FAILURE;
+        }
 
-        if (s.lookupValue("offset", offset)) {
-            s.lookupValue("inv", inv);
-            activity_flags.push_back(make_pair((unsigned int)offset, inv));
+        if (!src->data()) {
+            cerr << "No telemetry yet, waiting for the game to start (Ctrl+C to cancel)." << endl;
+            src->wait();
         }
+        data = src->data();
     }
 
-    const auto& rpm_leds = cfg.lookup("rpm.leds");
-    vector<indicator> rpm_indicators;
-    vector<moza::color_n> rpm_colors;
+    // whatever the source, every offset of the config has to be within
+    // the image it gives
+    const size_t telemetry_size = src? src->size() : size_t(sopt.size);
+
+    // the indicators only need a base for the offsets; not the game's
+    // mapping, which is gone once the game quits, and a config may be
+    // loaded any time after that
+    const vector<uint8_t> layout(telemetry_size, 0);
+    const volatile uint8_t *const layout_base = layout.data();
+
+    // the RPM bar may want a faster pace than the buttons
+    unsigned int cycle = cfg.lookup("cycle_ms");
+    unsigned int rpm_cycle = cycle;
+    unsigned int btn_cycle = cycle;
 
-    for (const Setting &c: rpm_leds) {
-        indicator i(c, data);
+    cfg.lookupValue("rpm_cycle_ms", rpm_cycle);
+    cfg.lookupValue("button_cycle_ms", btn_cycle);
 
-        rpm_indicators.push_back(i);
-        rpm_colors.push_back(make_pair(i.n(), i.color()));
+    if (rpm_cycle == 0 || btn_cycle == 0) {
+        cerr << "cycle_ms must be more than 0" << endl;
+        return EXIT_FAILURE;
     }
 
-    moza::set_telemetry_colors(port, moza::RPM, rpm_colors);
-    moza::set_rpm_mode(port, moza::TELEMETRY);
-    moza::send_telemetry(port, moza::RPM, 0);
+    unsigned int resync = 0;
+
+    cfg.lookupValue("resync_ms", resync);
 
-    vector<moza::color_n> p1;
+    // while the game isn't running: keep showing the last state, turn all
+    // off, or show the buttons as they were before (the idle colors)
+    enum { KEEP, OFF, IDLE } idle_leds = KEEP;
+    unsigned int idle_max_ms = 1000;
 
-    // get current idle button colors
-    for (int i = 0; i < 14; ++i) {
-        p1.push_back(make_pair(i, moza::get_led_color(port, moza::BUTTON, i)));
+    if (cfg.exists("idle")) {
+        const auto &c = cfg.lookup("idle");
+        string l = "keep";
+
+        c.lookupValue("max_ms", idle_max_ms);
+        c.lookupValue("leds", l);
+        if (l == "off")         idle_leds = OFF;
+        else if (l == "idle")   idle_leds = IDLE;
+        else if (l != "keep") {
+            cerr << "idle.leds must be \"keep\", \"off\" or \"idle\"" << endl;
+            return EXIT_FAILURE;
+        }
     }
 
-    // set new colors for the leds used for telemetry
-    const auto &btn_leds = cfg.lookup("button_leds");
-    vector<indicator> btn_indicators;
-    vector<int> used_btns;
-    vector<moza::color_n> btn_colors = p1;
+    // current idle button colors of each device, read once, a reloaded
+    // config reuses them
+    bool idle_colors_cache = false;
+
+    cfg.lookupValue("idle_colors_cache", idle_colors_cache);
+
+    vector<vector<moza::color_n> > p1(specs.size());
+
+    for (size_t k = 0; k < specs.size(); ++k) {
+        moza::transport &port = *ports[k];
+
+        if (specs[k].has_rpm) moza::set_rpm_mode(port, moza::TELEMETRY);
+        if (!specs[k].has_buttons) continue;
 
-    for (const Setting &c: btn_leds) {
-        indicator i(c, data);
+        const string state_fname = idle_colors_cache? state_name(specs[k].name) : string();
 
-        btn_indicators.push_back(i);
-        used_btns.push_back(i.n());
-        btn_colors.at(i.n()) = make_pair(i.n(), i.color());
+        if (!state_fname.empty()) p1[k] = load_colors(state_fname, 14);
+        if (!p1[k].empty()) continue;
+
+        vector<RGB> colors;
+
+        try {
+            colors = moza::get_led_colors(port, moza::BUTTON, 14);
+        } catch (const exception &e) {
+            cerr << "Can't read the button colors from the "
+                 << (specs[k].name.empty()? "wheel" : specs[k].name) << ": " << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+
+        for (uint8_t i = 0; i < colors.size(); ++i) p1[k].push_back(make_pair(i, colors[i]));
+        if (!state_fname.empty() && port.is_open()) save_colors(state_fname, p1[k]);
     }
-    moza::set_telemetry_colors(port, moza::BUTTON, btn_colors);
 
-    uint32_t used_bits = 0;
+    unique_ptr<leds_config> leds;
 
-    for (auto n: used_btns) {
-        used_bits |= 1 << n;
+    try {
+        leds = make_unique<leds_config>(cfg, p1, layout_base, telemetry_size);
+    } catch (const SettingException &e) {
+        cerr << "config: " << e.what() << " at " << e.getPath() << endl;
+        return EXIT_FAILURE;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
     }
 
-    const uint32_t unused = 0x3fff & ~used_bits;
+    // from now on each port is written only from its own thread, so that a
+    // slow device doesn't hold up the others
+    vector<unique_ptr<moza::writer> > writers;
+
+    for (size_t k = 0; k < specs.size(); ++k) {
+        const auto &d = leds->devices[k];
+        moza::shadow wheel(resync);
+        moza::batch out(*ports[k]);
 
-    for(;;) {
-        uint32_t bits = 0;
+        // set the colors of the leds used for telemetry, none lit yet
+        if (specs[k].has_rpm) {
+            wheel.set_telemetry_colors(out, moza::RPM, d.rpm_base);
+            wheel.send_telemetry(out, moza::RPM, 0);
+        }
+        if (specs[k].has_buttons) wheel.set_telemetry_colors(out, moza::BUTTON, d.btn_base);
+        moza::flush(*ports[k], out, true);
+
+        writers.push_back(make_unique<moza::writer>(*ports[k], std::move(wheel)));
+    }
+
+    // no allocations in the loop below, whatever config comes next
+    vector<moza::color_n> btn_colors;
+    vector<moza::color_n> rpm_colors;
+    vector<moza::color_n> full;
+
+    btn_colors.reserve(moza::max_leds);
+    rpm_colors.reserve(moza::max_leds);
+    full.reserve(moza::max_leds);
+
+    // as the loop was started, for the threads it spawns later
+    const vector<int> normal_cpus = realtime::affinity(pthread_self());
+
+    // the loop and the writers ahead of the game, nothing to fault in
+    {
+        using st = moza::stats;
+        uint32_t asked = 0;
+        uint32_t applied = 0;
+        auto apply = [&](uint32_t bit, bool wanted, auto f) {
+            if (!wanted) return;
+            asked |= bit;
+            if (f()) applied |= bit;
+        };
+
+        apply(st::RT_LOCK_MEMORY, rt.lock_memory, [] { return realtime::lock_memory(); });
+        apply(st::RT_PRIORITY, rt.priority > 0, [&] {
+            return realtime::set_priority(pthread_self(), rt.priority, "the telemetry loop");
+        });
+        apply(st::RT_AFFINITY, !rt.cpus.empty(), [&] {
+            return realtime::set_affinity(pthread_self(), rt.cpus, "the telemetry loop");
+        });
+        apply(st::RT_SERIAL_PRIORITY, rt.serial_priority > 0, [&] {
+            bool ok = true;
+
+            for (auto &w: writers) ok &= realtime::set_priority(w->native_handle(), rt.serial_priority, "a serial writer");
+            return ok;
+        });
+        apply(st::RT_SERIAL_AFFINITY, !rt.serial_cpus.empty(), [&] {
+            bool ok = true;
+
+            for (auto &w: writers) ok &= realtime::set_affinity(w->native_handle(), rt.serial_cpus, "a serial writer");
+            return ok;
+        });
+        // the writers' stacks are in use already, and they're waiting for
+        // the first post, not tracing anything meanwhile; the snapshot and
+        // the engines are written through as they're made
+        apply(st::RT_PREFAULT, rt.prefault, [&] {
+            if (data) realtime::prefault(data, telemetry_size, false);
+            realtime::prefault(&moza::wire, sizeof(moza::wire), true);
+            for (auto &w: writers) w->prefault();
+            for (auto *v: {&btn_colors, &rpm_colors, &full}) {
+                v->resize(v->capacity());
+                v->clear();
+            }
+            realtime::prefault_stack();
+            return true;
+        });
+
+        moza::metrics->rt_requested.store(asked, memory_order_relaxed);
+        moza::metrics->rt_applied.store(applied, memory_order_relaxed);
+    }
+
+    unique_ptr<recorder> rec;
+
+    if (!record_fname.empty()) {
+        try {
+            rec = make_unique<recorder>(record_fname, leds->snap);
+        } catch (const exception &e) {
+            cerr << e.what() << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // a changed config file is loaded while the old one is still in use
+    unique_ptr<file_watch> conf_watch;
+
+    if (!rec) {
+        try {
+            conf_watch = make_unique<file_watch>(conf_fname);
+        } catch (const exception &e) {
+            cerr << e.what() << ", the config will be reloaded only on SIGHUP" << endl;
+        }
+    }
+    future<unique_ptr<leds_config> > loading;
+    bool load_again = false;
+
+    // stop cleanly, for the recording to be complete
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGHUP, on_reload);
+    signal(SIGUSR1, on_dump);
+
+    // ticks as often as the faster group needs, the other runs every few ticks
+    scheduler sched(gcd(rpm_cycle, btn_cycle));
+    const unsigned int rpm_every = rpm_cycle / sched.period_ms();
+    const unsigned int btn_every = btn_cycle / sched.period_ms();
+
+    using clock = chrono::steady_clock;
+    bool rpm_dirty = true;
+    bool btn_dirty = true;
+    // if the telemetry has changed since the set was last evaluated, for
+    // predictions to take only new values as samples
+    bool rpm_fresh = true;
+    bool btn_fresh = true;
+    // the colors of unlit LEDs may not be what the config says, after idle
+    // or a reload
+    bool rpm_restore = false;
+    bool btn_restore = false;
+
+    idle_state idle(idle_max_ms / sched.period_ms());
+
+    // with frame_counter.sync, each update of the game's is waited for
+    // instead, the timer is for when there are none
+    frame_sync frames(sched.period_ms());
+    bool synced = false;
+
+    int status = EXIT_SUCCESS;
+
+    while (!stop) {
+        uint32_t bits;
+        bool active = (data != nullptr);
+        int64_t taken_ns = 0;
+        const auto started = clock::now();
+
+        moza::metrics->cycles.add();
+
+        if (dump_trace) {
+            dump_trace = 0;
+            write_trace();
+        }
 
-        // inactive or paused
-        for (const auto& p: activity_flags) {
-            if(!(bool(data[p.first]) ^ p.second)) goto sleep;
+        if ((conf_watch && conf_watch->changed()) || reload) {
+            reload = 0;
+            if (rec) {
+                cerr << "Not reloading the config while recording." << endl;
+            } else {
+                load_again = true;
+            }
         }
 
-        btn_colors.clear();
-        for (auto &p: btn_indicators) {
-            p.update();
+        if (load_again && !loading.valid()) {
+            load_again = false;
+            loading = async(launch::async, [&conf_fname, &specs, &p1, &rt, &normal_cpus, layout_base, telemetry_size]() {
+                Config c;
+
+                // not to compete with the loop or the game while parsing
+                if (rt.priority > 0) realtime::set_priority(pthread_self(), 0, "the config reload");
+                if (!rt.cpus.empty() && !normal_cpus.empty()) {
+                    realtime::set_affinity(pthread_self(), normal_cpus, "the config reload");
+                }
 
-            if (p.is_on()) {
-                bits |= 1 << p.n();
-                if (p.is_multicolor()) {
-                    btn_colors.push_back(make_pair(p.n(), p.color()));
+                leds_config::read(conf_fname, c);
+                if (leds_config::read_devices(c) != specs) {
+                    throw runtime_error("the devices have changed, that needs a restart");
                 }
+                return make_unique<leds_config>(c, p1, layout_base, telemetry_size);
+            });
+        }
+
+        // swapped between cycles, the old one is still used until then
+        if (loading.valid() && loading.wait_for(chrono::seconds(0)) == future_status::ready) {
+            try {
+                leds = loading.get();
+                rpm_dirty = btn_dirty = true;
+                rpm_restore = btn_restore = true;
+                cerr << "Config reloaded." << endl;
+            } catch (const SettingException &e) {
+                cerr << "config: " << e.what() << " at " << e.getPath() << ", keeping the old one" << endl;
+            } catch (const exception &e) {
+                cerr << e.what() << ", keeping the old config" << endl;
+            }
+        }
+
+        leds_config &lc = *leds;
+
+        if (replay) {
+            try {
+                if (!replay->advance(replay_speed)) break;
+            } catch (const exception &e) {
+                cerr << e.what() << endl;
+                status = EXIT_FAILURE;
+                break;
             }
         }
 
-        if (!btn_colors.empty()) {
-            moza::set_telemetry_colors(port, moza::BUTTON, btn_colors);
-            usleep(1000);
+        // the game may have quit or restarted since
+        if (src) {
+            if (src->poll()) {
+                data = src->data();
+                if (data) rpm_dirty = btn_dirty = true;
+                if (data && rt.prefault) realtime::prefault(data, telemetry_size, false);
+            }
+            // datagrams come in an image of their own each
+            data = src->data();
+            active = (data != nullptr);
+        }
+
+        if (active) {
+            // if the game keeps writing, the last try is still better than nothing
+            lc.snap.take(data);
+            taken_ns = chrono::duration_cast<chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+            if (rec) rec->record();
+
+            // inactive or paused
+            for (const auto& p: lc.activity_flags) {
+                if(!(bool(lc.snap.data()[p.first]) ^ p.second)) active = false;
+            }
         }
-        moza::send_telemetry(port, moza::BUTTON, bits | unused);
-
-        rpm_colors.clear();
-        bits = 0;
-        for (auto &p: rpm_indicators) {
-            p.update();
-            if (p.is_on()) {
-                bits |= 1 << p.n();
-                if (p.is_multicolor()) {
-                    rpm_colors.push_back(make_pair(p.n(), p.color()));
+
+        if (!active) {
+            if (idle.inactive() && idle_leds != KEEP) {
+                for (size_t k = 0; k < specs.size(); ++k) {
+                    auto &wr = *writers[k];
+
+                    if (specs[k].has_buttons) {
+                        if (idle_leds == IDLE)  wr.submit(moza::BUTTON, 0x3fff, p1[k]);
+                        else                    wr.submit(moza::BUTTON, 0, {});
+                    }
+                    if (specs[k].has_rpm) wr.submit(moza::RPM, 0, {});
+                    wr.post();
                 }
+                btn_restore |= (idle_leds == IDLE);
             }
+            goto sleep;
         }
-        if (!rpm_colors.empty()) {
-            moza::set_telemetry_colors(port, moza::RPM, rpm_colors);
-            usleep(1000);
+
+        if (idle.active()) {
+            // whatever it shows now may be outdated
+            rpm_dirty = btn_dirty = true;
+        }
+
+        rpm_dirty |= lc.snap.changed();
+        btn_dirty |= lc.snap.changed();
+        rpm_fresh |= lc.snap.changed();
+        btn_fresh |= lc.snap.changed();
+
+        {
+            // all the devices from the same snapshot
+            const bool btn_due = btn_dirty && (synced || sched.due(btn_every));
+            const bool rpm_due = rpm_dirty && (synced || sched.due(rpm_every));
+            // a change held back is shown later even if nothing else changes
+            bool btn_holding = false;
+            bool rpm_holding = false;
+
+            for (size_t k = 0; k < specs.size() && (btn_due || rpm_due); ++k) {
+                auto &d = lc.devices[k];
+                auto &wr = *writers[k];
+
+                // predictions look ahead by how long it takes to be shown: the
+                // change is half a cycle old on average, or new if synced, then
+                // it's written
+                if (btn_due && specs[k].has_buttons) {
+                    const auto t0 = clock::now();
+
+                    d.btn_engine.set_time(taken_ns, (synced? 0 : btn_cycle * 500000LL) + wr.latency_ns());
+                    d.btn_engine.evaluate(lc.snap.data(), bits, btn_colors, btn_fresh);
+                    moza::metrics->evaluation.record(chrono::nanoseconds(clock::now() - t0).count());
+                    moza::metrics->evaluations.add();
+                    btn_holding |= d.btn_engine.holding();
+
+                    if (btn_restore) {
+                        overlay(d.btn_base, btn_colors, full);
+                        wr.submit(moza::BUTTON, bits | d.unused, full);
+                    } else {
+                        wr.submit(moza::BUTTON, bits | d.unused, btn_colors);
+                    }
+                }
+
+                if (rpm_due && specs[k].has_rpm) {
+                    const auto t0 = clock::now();
+
+                    d.rpm_engine.set_time(taken_ns, (synced? 0 : rpm_cycle * 500000LL) + wr.latency_ns());
+                    d.rpm_engine.evaluate(lc.snap.data(), bits, rpm_colors, rpm_fresh);
+                    moza::metrics->evaluation.record(chrono::nanoseconds(clock::now() - t0).count());
+                    moza::metrics->evaluations.add();
+                    rpm_holding |= d.rpm_engine.holding();
+
+                    if (rpm_restore) {
+                        overlay(d.rpm_base, rpm_colors, full);
+                        wr.submit(moza::RPM, bits, full);
+                    } else {
+                        wr.submit(moza::RPM, bits, rpm_colors);
+                    }
+                }
+
+                // only the differences from what the device already shows are
+                // sent, all in one write
+                wr.post();
+            }
+
+            if (btn_due) {
+                btn_dirty = btn_holding;
+                btn_fresh = false;
+                btn_restore = false;
+            }
+            if (rpm_due) {
+                rpm_dirty = rpm_holding;
+                rpm_fresh = false;
+                rpm_restore = false;
+            }
         }
-        moza::send_telemetry(port, moza::RPM, bits);
 sleep:
-        usleep(cycle*1000L);
+        moza::metrics->cycle.record(chrono::nanoseconds(clock::now() - started).count());
+        {
+            // a paused game may keep its counter going, or stop it
+            const bool follow = lc.sync && lc.snap.has_counter() && data && src && src->in_place() &&
+                                !idle.idle();
+
+            if (follow != synced) {
+                synced = follow;
+                if (!synced) sched.restart();
+            }
+        }
+        if (synced) {
+            frames.wait(lc.snap, data);
+        } else if (!replay || replay_speed > 0) {
+            // a game starting is noticed right away, not after the backoff
+            sched.wait(idle.periods(), (src && !data)? src->fd() : -1);
+        } else {
+            sched.step();
+        }
+    }
+
+    // not to be left running on exit
+    if (loading.valid()) loading.wait();
+
+    if (moza::debug) {
+        const auto &st = sched.stats();
+
+        write_trace();
+
+        cerr << leds->snap.unchanged() << " of " << leds->snap.takes() << " cycles skipped, telemetry unchanged" << endl;
+        cerr << "idle " << idle.entered() << " times" << endl;
+
+        uint64_t suppressed = 0;
+
+        for (const auto &d: leds->devices) {
+            suppressed += d.rpm_engine.suppressed() + d.btn_engine.suppressed();
+        }
+        cerr << suppressed << " LED changes held back by hysteresis or hold times" << endl;
+
+        const auto &fs = frames.stats();
+
+        if (fs.frames || fs.timeouts) {
+            cerr << fs.frames << " game updates waited for, " << fs.missed << " missed, "
+                 << fs.timeouts << " timeouts, " << fs.polls << " polls, one every "
+                 << frames.period_ns() / 1000 << " us" << endl;
+        }
+        if (st.cycles) {
+            cerr << st.cycles << " cycles of " << sched.period_ms() << " ms, "
+                 << st.overruns << " deadlines missed, woken up late by "
+                 << st.late_min_ns / 1000 << "/" << st.late_sum_ns / int64_t(st.cycles) / 1000 << "/"
+                 << st.late_max_ns / 1000 << " us (min/avg/max)" << endl;
+        }
     }
 
-    return 0;
+    return status;
 }
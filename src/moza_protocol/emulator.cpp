@@ -0,0 +1,230 @@
+#include "emulator.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "frame.h"
+
+namespace {
+
+void write_all(int fd, const uint8_t *p, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return; // nobody listening
+        }
+        p += n;
+        size -= n;
+    }
+}
+
+std::runtime_error sys_error(const std::string &what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+namespace moza {
+
+emulator::emulator(const emulator_options &opt)
+    : m_opt(opt), m_in(parser::CHECKSUM), m_random(std::random_device()())
+{
+    m_master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (m_master < 0) throw sys_error("posix_openpt");
+
+    char name[128];
+
+    if (grantpt(m_master) < 0 || unlockpt(m_master) < 0 ||
+        ptsname_r(m_master, name, sizeof(name)) != 0) {
+        close(m_master);
+        throw sys_error("pty");
+    }
+    m_path = name;
+
+    m_slave = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (m_slave < 0) {
+        close(m_master);
+        throw sys_error(m_path);
+    }
+
+    termios t;
+
+    tcgetattr(m_slave, &t);
+    cfmakeraw(&t);
+    tcsetattr(m_slave, TCSANOW, &t);
+
+    for (auto &s: m_telemetry_colors) s.fill(RGB::black);
+    for (auto &s: m_led_colors) s.fill(m_opt.idle_color);
+
+    m_thread = std::thread(&emulator::run, this);
+}
+
+emulator::~emulator()
+{
+    m_stop.store(true);
+    m_thread.join();
+    close(m_slave);
+    close(m_master);
+}
+
+void emulator::on_frame(std::function<void(const received&)> f)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_on_frame = std::move(f);
+}
+
+std::vector<emulator::received> emulator::frames() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return std::vector<received>(m_frames.begin(), m_frames.end());
+}
+
+void emulator::clear_frames()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_frames.clear();
+}
+
+uint32_t emulator::mask(led_set ctl) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_mask.at(ctl);
+}
+
+RGB emulator::telemetry_color(led_set ctl, uint8_t n) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_telemetry_colors.at(ctl).at(n);
+}
+
+RGB emulator::led_color(led_set ctl, uint8_t n) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_led_colors.at(ctl).at(n);
+}
+
+mode emulator::leds_mode(led_set ctl) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_mode.at(ctl);
+}
+
+void emulator::run()
+{
+    while (!m_stop.load()) {
+        pollfd p = {m_master, POLLIN, 0};
+
+        if (poll(&p, 1, 100) <= 0) continue;
+        if (m_in.read(m_master) <= 0) continue;
+
+        const auto now = clock::now();
+
+        while (m_in.next()) {
+            handle({now, std::vector<uint8_t>(m_in.data(), m_in.data() + m_in.size()), m_in.ok()});
+        }
+    }
+}
+
+void emulator::handle(const received &r)
+{
+    std::function<void(const received&)> f;
+    std::vector<uint8_t> ans;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_opt.keep_frames) {
+            if (m_frames.size() == m_opt.keep_frames) m_frames.pop_front();
+            m_frames.push_back(r);
+        }
+        f = m_on_frame;
+
+        const auto &d = r.data;
+        const size_t end = 4 + d[1]; // the checksum
+
+        if (r.ok && d[1] >= 2 && d[5] < 2) {
+            const uint8_t cmd = d[4];
+            const led_set ctl = led_set(d[5]);
+
+            if (d[2] == WRITE) {
+                if (cmd == 0x19) {
+                    for (size_t i = 6; i + 4 <= end; i += 4) {
+                        if (d[i] < max_leds) {
+                            m_telemetry_colors[ctl][d[i]] = RGB(d[i + 1], d[i + 2], d[i + 3]);
+                        }
+                    }
+                } else if (cmd == 0x1a && end >= 10) {
+                    m_mask[ctl] = d[6] | d[7] << 8 | d[8] << 16 | uint32_t(d[9]) << 24;
+                } else if (cmd == 0x1c && end >= 7) {
+                    m_mode[ctl] = mode(d[6]);
+                } else if (cmd == 0x1f && end >= 11 && d[7] < max_leds) {
+                    m_led_colors[ctl][d[7]] = RGB(d[8], d[9], d[10]);
+                }
+            } else if (d[2] == READ) {
+                ans.assign(d.begin(), d.begin() + end);
+                ans[2] |= 0x80;
+                ans[3] = (d[3] & 0xf) << 4 | (d[3] & 0xf0) >> 4;
+
+                if (cmd == 0x1f && end >= 11 && d[7] < max_leds) {
+                    const auto [red, green, blue] = m_led_colors[ctl][d[7]].rgb();
+
+                    ans[8] = red;
+                    ans[9] = green;
+                    ans[10] = blue;
+                } else if (cmd == 0x1c && end >= 7) {
+                    ans[6] = m_mode[ctl];
+                } else {
+                    ans.clear();
+                }
+            }
+        }
+    }
+
+    if (f) f(r);
+    if (!ans.empty()) reply(ans);
+}
+
+void emulator::reply(std::vector<uint8_t> &ans)
+{
+    std::uniform_real_distribution<double> chance(0, 1);
+
+    ans.push_back(std::accumulate(ans.begin(), ans.end(), MAGIC_VALUE));
+    if (chance(m_random) < m_opt.nok) ++ans.back();
+
+    // every start byte after the first one escaped
+    for (size_t i = 1; i < ans.size(); ++i) {
+        if (ans[i] == START) ans.insert(ans.begin() + ++i, START);
+    }
+
+    if (m_opt.delay_ms) std::this_thread::sleep_for(std::chrono::milliseconds(m_opt.delay_ms));
+
+    if (chance(m_random) < m_opt.garbage) {
+        uint8_t junk[8];
+
+        for (auto &b: junk) b = m_random();
+        write_all(m_master, junk, sizeof(junk));
+    }
+
+    write_all(m_master, ans.data(), ans.size());
+}
+
+}	// namespace moza
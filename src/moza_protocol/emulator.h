@@ -0,0 +1,92 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "proto.h"
+#include "parser.h"
+
+namespace moza {
+
+struct emulator_options {
+    unsigned int delay_ms = 2;      // before a reply
+    double nok = 0;                 // probability of a reply with a wrong checksum
+    double garbage = 0;             // probability of junk bytes before a reply
+    RGB idle_color = RGB::mozacyan; // what the buttons show initially
+    size_t keep_frames = 0;         // the last ones frames() returns
+};
+
+// A MOZA device on a pseudo-terminal, for testing and timing the serial I/O
+// without the hardware. It keeps the LED state written to it, answers LED
+// color and mode reads, and timestamps every frame it receives. Runs in its
+// own thread.
+class emulator {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct received {
+        clock::time_point t;
+        std::vector<uint8_t> data;  // unescaped
+        bool ok;                    // checksum matches
+    };
+
+    explicit emulator(const emulator_options &opt = emulator_options());
+    ~emulator();
+
+    emulator(const emulator&) = delete;
+    emulator& operator=(const emulator&) = delete;
+
+    // the device to open as the serial port
+    const std::string &path() const { return m_path; }
+
+    // called from the emulator's thread for every frame, set it before use
+    void on_frame(std::function<void(const received&)> f);
+
+    // the last keep_frames of them
+    std::vector<received> frames() const;
+    void clear_frames();
+
+    uint32_t mask(led_set ctl) const;
+    RGB telemetry_color(led_set ctl, uint8_t n) const;
+    RGB led_color(led_set ctl, uint8_t n) const;
+    mode leds_mode(led_set ctl) const;
+
+private:
+    void run();
+    void handle(const received &r);
+    void reply(std::vector<uint8_t> &ans);
+
+    emulator_options m_opt;
+
+    int m_master;
+    int m_slave;                    // kept open so that the master never hangs up
+    std::string m_path;
+
+    parser m_in;
+
+    mutable std::mutex m_mutex;
+    std::function<void(const received&)> m_on_frame;
+    std::deque<received> m_frames;
+    std::array<uint32_t, 2> m_mask = {};
+    std::array<std::array<RGB, max_leds>, 2> m_telemetry_colors;
+    std::array<std::array<RGB, max_leds>, 2> m_led_colors;
+    std::array<mode, 2> m_mode = {OFF, TELEMETRY};
+
+    std::mt19937 m_random;
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+};
+
+}	// namespace moza
+
+#endif // EMULATOR_H
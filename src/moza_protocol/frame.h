@@ -0,0 +1,79 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+#include "rgb.h"
+
+namespace moza {
+
+constexpr uint8_t MAGIC_VALUE = 0x0d;
+constexpr uint8_t START = 0x7e;
+constexpr uint8_t DEVICE = 0x17;
+
+enum group : uint8_t { WRITE = 0x3f, READ = 0x40 };
+
+// Everything known about a command at compile time: its header and the
+// checksum of it, so only the length and the payload are summed at runtime.
+template <uint8_t Group, uint8_t Cmd>
+struct command {
+    static constexpr uint8_t group = Group;
+    static constexpr uint8_t cmd = Cmd;
+    static constexpr uint8_t seed = uint8_t(MAGIC_VALUE + START + Group + DEVICE + Cmd);
+};
+
+using led_color_cmd        = command<WRITE, 0x1f>;
+using telemetry_colors_cmd = command<WRITE, 0x19>;
+using telemetry_cmd        = command<WRITE, 0x1a>;
+using leds_mode_cmd        = command<WRITE, 0x1c>;
+
+// A frame in a fixed-size buffer on the stack, its checksum is accumulated
+// as the payload is added. Payload is the maximum number of bytes following
+// the command byte. Only the checksum is escaped, doubled if it happens to
+// be the start byte.
+template <typename Cmd, size_t Payload>
+class frame {
+public:
+    // start, length, group, device, command + payload + checksum + its escape
+    static constexpr size_t capacity = 5 + Payload + 2;
+
+    frame() : m_buf{START, 0, Cmd::group, DEVICE, Cmd::cmd} {}
+
+    void push(uint8_t b)
+    {
+        m_buf[m_size++] = b;
+        m_sum += b;
+    }
+
+    void push(const RGB &c)
+    {
+        const auto [r, g, b] = c.rgb();
+
+        push(uint8_t(r));
+        push(uint8_t(g));
+        push(uint8_t(b));
+    }
+
+    // the length byte counts the command and the payload
+    void finish()
+    {
+        m_buf[1] = uint8_t(m_size - 4);
+        m_sum += m_buf[1];
+        m_buf[m_size++] = m_sum;
+        if (m_sum == START) m_buf[m_size++] = START; // escaped
+    }
+
+    const uint8_t *data() const { return m_buf.data(); }
+    size_t size() const { return m_size; }
+
+private:
+    std::array<uint8_t, capacity> m_buf;
+    size_t m_size = 5;
+    uint8_t m_sum = Cmd::seed;
+};
+
+}	// namespace moza
+
+#endif // FRAME_H
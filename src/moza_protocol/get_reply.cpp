@@ -1,90 +1,63 @@
+#include "get_reply.h"
 #include "proto.h"
+#include "parser.h"
+#include "stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
-#include <iomanip>
 
 namespace {
 
 const size_t timeout = 1000; // ms
 
-std::vector<uint8_t> receive_answer(LibSerial::SerialPort &port, const std::vector<uint8_t> &req)
+// the length, group and device of a reply to req
+bool reply_header(const std::vector<uint8_t> &in, const std::vector<uint8_t> &req)
 {
-    enum { WAIT, STARTED, END} state = WAIT;
+    return in[1] == req[1] && req[2] == (in[2] & 0x7f) &&
+           req[3] == ((in[3] & 0xf) << 4 | (in[3] & 0xf0) >> 4);
+}
 
-    std::vector<uint8_t> ret;
+std::vector<uint8_t> receive_answer(moza::transport &port, const std::vector<uint8_t> &req)
+{
+    moza::parser in;
 
-    uint8_t byte;
-    uint8_t dummy;
-    std::vector<uint8_t> buffer;
+    for (;;) {
+        if (!port.wait_readable(timeout)) throw read_timeout();
+        in.read(port.fd());
 
-    while (state != END) {
-        switch(state) {
-        case WAIT:
-            try {
-                port.ReadByte(byte, timeout);
-            } catch (const LibSerial::ReadTimeout &) {
-                std::cerr << "ReadTimeout" << std::endl;
-                break;
-            }
-            if (byte == 0x7e) {
-                ret.push_back(byte);
-                state = STARTED;
-            }
-            break;
-        case STARTED:
-            port.Read(buffer, 3, timeout); // header
-            ret.insert(ret.end(),buffer.begin(), buffer.end());
-
-            port.Read(buffer, ret[1], timeout);
-            port.ReadByte(byte, timeout);
-            if (byte == 0x7e) port.ReadByte(dummy, timeout); // escaped
-
-            if (req[2] != (ret[2] & 0x7f) ||
-                req[3] != ((ret[3] & 0xf) << 4 | (ret[3] & 0xf0) >> 4)) {
-                ret.clear();
-                state = WAIT;
-                break;
-            }
+        while (in.next()) {
+            std::vector<uint8_t> ret(in.data(), in.data() + in.size());
 
-            ret.insert(ret.end(), buffer.begin(), buffer.end());
-            if (byte != moza::chksum(ret)) {
-                throw NOK_error("NOK"); // NOK
-            }
-            ret.push_back(byte);
-            state = END;
-            break;
-        default:
-            break;
+            if (!reply_header(ret, req)) continue; // something else
+
+            if (!in.ok()) throw NOK_error("NOK");
+            return ret;
         }
     }
-
-    return ret;
 }
 
 } // namespace
 
 namespace moza {
 
-std::vector<uint8_t> get_reply(LibSerial::SerialPort &port, const std::vector<uint8_t>& request, int retries)
+std::vector<uint8_t> get_reply(transport &port, const std::vector<uint8_t>& request, int retries)
 {
     int tries = retries;
     std::vector<uint8_t> v;
 
     while (tries > 0) {
-        if (debug) {
-            for (auto b: request) {
-                std::cout << std::hex << std::setw(2) << int(b) << ' ';
-            }
-            std::cout << std::endl;
-        }
-        port.FlushInputBuffer();
-        port.DrainWriteBuffer();
-        port.Write(request);
-        if (port.IsDataAvailable()) port.FlushInputBuffer();
+        port.flush_input();
+        port.drain();
+        wire.record(trace::TX, port.fd(), request.data(), request.size());
+        port.write(request.data(), request.size());
 
         try {
             v = receive_answer(port, request);
             break;
         } catch(const NOK_error &e) {
+            if (dynamic_cast<const read_timeout*>(&e))      metrics->read_timeouts.add();
+            else                                            metrics->nok_retries.add();
             if (--tries == 0) {
                 std::cerr << e.what() << ", failed" << std::endl;
                 throw;
@@ -93,14 +66,94 @@ std::vector<uint8_t> get_reply(LibSerial::SerialPort &port, const std::vector<ui
         }
     }
 
-    if (debug) {
-        std::cout << '\t';
-        for (auto b: v) {
-            std::cout << std::hex << std::setw(2) << int(b) << ' ';
+    return v;
+}
+
+std::vector<std::vector<uint8_t> > get_replies(transport &port,
+                                               const std::vector<std::vector<uint8_t> > &requests,
+                                               size_t key, int tries)
+{
+    using clock = std::chrono::steady_clock;
+
+    const auto wait = std::chrono::milliseconds(timeout);
+
+    std::vector<std::vector<uint8_t> > replies(requests.size());
+    std::vector<int> left(requests.size(), tries);
+    std::vector<clock::time_point> sent(requests.size());
+    size_t outstanding = requests.size();
+
+    std::vector<iovec> out;             // requests to be sent
+    parser in;
+
+    auto resend = [&](size_t i, bool timed_out) {
+        const char *why = timed_out? "ReadTimeout" : "NOK";
+
+        if (timed_out)  metrics->read_timeouts.add();
+        else            metrics->nok_retries.add();
+        if (--left[i] <= 0) {
+            std::cerr << why << ", failed" << std::endl;
+            if (timed_out) throw read_timeout();
+            throw NOK_error(why);
         }
-        std::cout << std::endl;
+        std::cerr << why << ", retrying" << std::endl;
+        out.push_back({const_cast<uint8_t*>(requests[i].data()), requests[i].size()});
+        sent[i] = clock::now();
+    };
+
+    port.flush_input();
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        out.push_back({const_cast<uint8_t*>(requests[i].data()), requests[i].size()});
+        sent[i] = clock::now();
     }
 
-    return v;
+    while (outstanding > 0) {
+        if (!out.empty()) {
+            wire.record(trace::TX, port.fd(), out.data(), out.size());
+            port.write(out.data(), out.size());
+            out.clear();
+        }
+
+        // until the oldest outstanding request times out
+        auto deadline = clock::time_point::max();
+
+        for (size_t i = 0; i < requests.size(); ++i) {
+            if (replies[i].empty()) deadline = std::min(deadline, sent[i] + wait);
+        }
+
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now());
+
+        if (port.wait_readable(std::max<int>(ms.count(), 0))) in.read(port.fd());
+
+        while (in.next()) {
+            // without the checksum
+            const std::vector<uint8_t> ans(in.data(), in.data() + in.size() - 1);
+
+            for (size_t i = 0; i < requests.size(); ++i) {
+                if (!replies[i].empty() || requests[i].size() < key || ans.size() < key ||
+                    !reply_header(ans, requests[i]) ||
+                    !std::equal(requests[i].begin() + 4, requests[i].begin() + key, ans.begin() + 4)) {
+                    continue;
+                }
+
+                if (!in.ok()) {
+                    resend(i, false);
+                } else {
+                    replies[i].assign(in.data(), in.data() + in.size());
+                    --outstanding;
+                }
+                break;
+            }
+        }
+
+        const auto now = clock::now();
+
+        for (size_t i = 0; i < requests.size(); ++i) {
+            if (replies[i].empty() && now - sent[i] >= wait) resend(i, true);
+        }
+    }
+
+    return replies;
 }
+
 } // namespace moza
@@ -2,12 +2,22 @@
 #define GET_REPLY_H
 
 #include <vector>
+#include <cstddef>
 #include <cstdint>
-#include <libserial/SerialPort.h>
+#include "transport.h"
 
 namespace moza {
 
-std::vector<uint8_t> get_reply(LibSerial::SerialPort &port, const std::vector<uint8_t>& request, int retries = 2);
+std::vector<uint8_t> get_reply(transport &port, const std::vector<uint8_t>& request, int retries = 2);
+
+// Sends all the requests at once, then collects the replies in any order.
+// A reply belongs to the request that has the same first key bytes (after
+// the group and device, which are changed in replies), unescaped. Requests not answered
+// in time or answered with a wrong checksum are sent again, up to tries
+// times in all, then NOK_error (read_timeout if unanswered) is thrown.
+std::vector<std::vector<uint8_t> > get_replies(transport &port,
+                                               const std::vector<std::vector<uint8_t> > &requests,
+                                               size_t key, int tries = 3);
 
 }
 
@@ -0,0 +1,49 @@
+#include "libserial_transport.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <poll.h>
+#include <unistd.h>
+
+namespace moza {
+
+void libserial_transport::write(const uint8_t *p, size_t size)
+{
+    const int fd = m_port.GetFileDescriptor();
+
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("serial write failed: ") + std::strerror(errno));
+        }
+        p += n;
+        size -= n;
+    }
+}
+
+// one at a time, as the port is blocking anyway
+void libserial_transport::write(const iovec *v, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        write(static_cast<const uint8_t*>(v[i].iov_base), v[i].iov_len);
+    }
+}
+
+bool libserial_transport::wait_readable(int timeout_ms)
+{
+    pollfd p = {m_port.GetFileDescriptor(), POLLIN, 0};
+
+    for (;;) {
+        const int n = poll(&p, 1, timeout_ms);
+
+        if (n >= 0) return n > 0;
+        if (errno != EINTR) {
+            throw std::runtime_error(std::string("serial poll failed: ") + std::strerror(errno));
+        }
+    }
+}
+
+}	// namespace moza
@@ -0,0 +1,32 @@
+#ifndef LIBSERIAL_TRANSPORT_H
+#define LIBSERIAL_TRANSPORT_H
+
+#include <libserial/SerialPort.h>
+
+#include "transport.h"
+
+namespace moza {
+
+// The port opened and set up by LibSerial, as it has always been. Writes go
+// around it to the fd, to avoid its copies.
+class libserial_transport : public transport {
+public:
+    void open(const std::string &path) override { m_port.Open(path); }
+    bool is_open() const override { return m_port.IsOpen(); }
+    int fd() const override { return m_port.GetFileDescriptor(); }
+
+    void write(const uint8_t *p, size_t size) override;
+    void write(const iovec *v, int n) override;
+
+    bool wait_readable(int timeout_ms) override;
+
+    void flush_input() override { m_port.FlushInputBuffer(); }
+    void drain() override { m_port.DrainWriteBuffer(); }
+
+private:
+    mutable LibSerial::SerialPort m_port;
+};
+
+}	// namespace moza
+
+#endif // LIBSERIAL_TRANSPORT_H
@@ -0,0 +1,120 @@
+#include "parser.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include <sys/uio.h>
+
+#include "frame.h"
+#include "trace.h"
+
+namespace moza {
+
+ssize_t parser::read(int fd)
+{
+    const size_t free = buffer_size - (m_tail - m_head);
+    const size_t pos = m_tail % buffer_size;
+    const size_t first = std::min(free, buffer_size - pos);
+
+    // the free space may wrap around
+    iovec v[2] = {{m_buf.data() + pos, first}, {m_buf.data(), free - first}};
+
+    if (free == 0) return 0;
+
+    const ssize_t n = readv(fd, v, v[1].iov_len? 2 : 1);
+
+    if (n > 0) {
+        m_tail += n;
+        v[0].iov_len = std::min<size_t>(n, first);
+        v[1].iov_len = n - v[0].iov_len;
+        wire.record(trace::RX, fd, v, 2);
+    }
+    return n;
+}
+
+void parser::feed(const uint8_t *p, size_t size)
+{
+    if (size > buffer_size - (m_tail - m_head)) {
+        throw std::length_error("parser buffer overflow");
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+        m_buf[m_tail++ % buffer_size] = p[i];
+    }
+}
+
+bool parser::next()
+{
+    while (m_head != m_tail) {
+        if (take(m_buf[m_head++ % buffer_size])) return true;
+    }
+    return false;
+}
+
+void parser::clear()
+{
+    m_head = m_tail;
+    m_state = WAIT;
+    m_escape = false;
+    m_sum_escape = false;
+    m_size = 0;
+}
+
+bool parser::take(uint8_t b)
+{
+    // the escape of the last frame's checksum, not a start
+    if (m_sum_escape) {
+        m_sum_escape = false;
+        if (b == START) return false;
+    }
+
+    if (m_state == WAIT) {
+        if (b == START) {
+            m_frame[0] = START;
+            m_size = 1;
+            m_state = LENGTH;
+        } else {
+            ++m_skipped;
+        }
+        return false;
+    }
+
+    if (m_escape) {
+        m_escape = false;
+
+        if (b != START) {
+            // it wasn't escaped, a new frame has started
+            m_skipped += m_size;
+            m_frame[0] = START;
+            m_size = 1;
+            m_state = LENGTH;
+        }
+    } else if (b == START && !(m_escaping == CHECKSUM && m_state == BODY)) {
+        if (m_state == LENGTH) {
+            // the length can't be a start, so that one was junk
+            ++m_skipped;
+        } else {
+            m_escape = true;
+        }
+        return false;
+    }
+
+    m_frame[m_size++] = b;
+
+    if (m_state == LENGTH) {
+        m_need = 4 + size_t(b) + 1;
+        m_state = BODY;
+    }
+
+    if (m_state != BODY || m_size < m_need) return false;
+
+    const uint8_t sum = std::accumulate(m_frame.begin(), m_frame.begin() + m_size - 1, MAGIC_VALUE);
+
+    m_ok = (sum == m_frame[m_size - 1]);
+    if (!m_ok) ++m_bad;
+    m_sum_escape = (m_escaping == CHECKSUM && m_frame[m_size - 1] == START);
+    m_state = WAIT;
+    return true;
+}
+
+}	// namespace moza
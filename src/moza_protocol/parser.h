@@ -0,0 +1,76 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+namespace moza {
+
+// Splits a byte stream into frames. Bytes are taken in bulk, read straight
+// from a (possibly non-blocking) fd into a ring buffer or fed by hand, and
+// parsed as far as they go: a frame may arrive in any number of pieces.
+// Escaped start bytes are unescaped. A lone start byte within a frame starts
+// a new one, and anything before a start is skipped, so it gets back in sync
+// after garbage.
+//
+// The device escapes any start byte in its frames; the host's frames have
+// only the checksum escaped, start bytes in their payload go as they are,
+// and are found by their length alone.
+class parser {
+public:
+    enum escaping { ALL, CHECKSUM };
+
+    explicit parser(escaping e = ALL) : m_escaping(e) {}
+
+    static constexpr size_t buffer_size = 4096;  // a power of 2
+    static constexpr size_t max_frame = 4 + 255 + 1;
+
+    // One read() into the free space, returns what read() does. Call next()
+    // until it returns false before the buffer fills up.
+    ssize_t read(int fd);
+
+    // throws std::length_error if there's no room
+    void feed(const uint8_t *p, size_t size);
+
+    // parses up to the end of the next complete frame, false if there's none yet
+    bool next();
+
+    // the frame found by next(), unescaped: start, length, group, device,
+    // command, payload, checksum
+    const uint8_t *data() const { return m_frame.data(); }
+    size_t size() const { return m_size; }
+    bool ok() const { return m_ok; }            // the checksum matches
+
+    void clear();
+
+    uint64_t skipped() const { return m_skipped; }  // bytes not in any frame
+    uint64_t bad() const { return m_bad; }          // frames with a wrong checksum
+
+private:
+    enum state { WAIT, LENGTH, BODY };
+
+    // true when b completes a frame
+    bool take(uint8_t b);
+
+    std::array<uint8_t, buffer_size> m_buf;
+    size_t m_head = 0;                          // both only grow
+    size_t m_tail = 0;
+
+    escaping m_escaping;
+    state m_state = WAIT;
+    bool m_escape = false;                      // the last byte was a start
+    bool m_sum_escape = false;                  // the checksum was, CHECKSUM only
+    std::array<uint8_t, max_frame> m_frame;
+    size_t m_size = 0;
+    size_t m_need = 0;
+    bool m_ok = false;
+
+    uint64_t m_skipped = 0;
+    uint64_t m_bad = 0;
+};
+
+}	// namespace moza
+
+#endif // PARSER_H
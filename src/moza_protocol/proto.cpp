@@ -2,39 +2,87 @@
 
 #include <numeric>
 #include <algorithm>
-#include <iostream>
-#include <iomanip>
 #include <cassert>
 
 #include "get_reply.h"
+#include "frame.h"
+#include "stats.h"
+#include "trace.h"
 
 
 namespace {
 
-const int MAGIC_VALUE = 0x0d;
+// what would be sent is traced even with the port closed
+void trace_tx(const moza::transport &port, const std::vector<uint8_t> &v)
+{
+    moza::wire.record(moza::trace::TX, port.fd(), v.data(), v.size());
+}
 
-void debug_print(const std::vector<uint8_t> &v)
+template <typename F>
+void finish(moza::transport &port, F& req)
 {
-    for (auto b: v) {
-        std::cout << std::hex << std::setw(2) << std::setfill('0') << int(b) << ' ';
+    req.finish();
+
+    moza::wire.record(moza::trace::TX, port.fd(), req.data(), req.size());
+
+    if (port.is_open()) {
+        port.flush_input();
+        port.drain();
+        port.write(req.data(), req.size());
+        moza::metrics->frames.add();
+        moza::metrics->bytes.add(req.size());
     }
-    std::cout << std::endl;
 }
 
-void finish(LibSerial::SerialPort& port, std::vector<uint8_t>& req)
+template <typename F>
+void finish(moza::batch &b, F& req)
 {
-    req.push_back(moza::chksum(req));
-    if (req.back() == 0x7e) req.push_back(0x7e);
+    req.finish();
+    b.append(req.data(), req.size());
+}
+
+template <typename Out>
+void telemetry_colors(Out &out, moza::led_set ctl, const std::vector<moza::color_n> &set)
+{
+    // better have it sorted by led numbers: put them in place by number
+    std::array<RGB, moza::max_leds> colors;
+    uint32_t present = 0;
 
-    if (moza::debug) debug_print(req);
+    for (const auto &c: set) {
+        colors[c.first] = c.second;
+        present |= 1u << c.first;
+    }
 
-    if (port.IsOpen()) {
-        port.FlushInputBuffer();
-        port.DrainWriteBuffer();
-        port.Write(req);
+    // form necessary number of requests containing max 5 items each
+    for (uint8_t n = 0; present;) {
+        moza::frame<moza::telemetry_colors_cmd, 1 + 5 * 4> req;
+
+        req.push(ctl);
+        for (int j = 0; j < 5 && present; ++n) {
+            if (present & (1u << n)) {
+                req.push(n);
+                req.push(colors[n]);
+                present &= ~(1u << n);
+                ++j;
+            }
+        }
+        finish(out, req);
     }
 }
 
+template <typename Out>
+void telemetry(Out &out, moza::led_set ctl, uint32_t mask)
+{
+    moza::frame<moza::telemetry_cmd, 5> req;
+
+    req.push(ctl);
+    req.push(uint8_t(mask & 0xff));
+    req.push(uint8_t(mask >> 8 & 0xff));
+    req.push(uint8_t(mask >> 16 & 0xff));
+    req.push(uint8_t(mask >> 24 & 0xff)); // 6
+    finish(out, req);
+}
+
 } // namespace
 
 namespace moza {
@@ -43,82 +91,76 @@ bool debug = false;
 
 uint8_t chksum(const std::vector<uint8_t>& data)
 {
-    unsigned int ret = std::accumulate(data.begin(), data.end(), MAGIC_VALUE);
+    unsigned int ret = std::accumulate(data.begin(), data.end(), int(MAGIC_VALUE));
 
     return uint8_t(ret % 0x100);
 }
 
-void set_led_color(LibSerial::SerialPort &port, led_set ctl, uint8_t n, RGB color)
+void set_led_color(transport &port, led_set ctl, uint8_t n, RGB color)
 {
-    const auto &c = color.rgb();
-    std::vector<uint8_t> req = {0x7e, 7, 0x3f, 0x17, 0x1f, ctl, 0xff, n,
-                              uint8_t(std::get<0>(c)),
-                              uint8_t(std::get<1>(c)),
-                              uint8_t(std::get<2>(c))}; // 7
+    frame<led_color_cmd, 6> req;
+
+    req.push(ctl);
+    req.push(0xff);
+    req.push(n);
+    req.push(color); // 7
     finish(port, req);
 }
 
-void set_rpm_mode(LibSerial::SerialPort &port, mode m)
+void set_rpm_mode(transport &port, mode m)
 {
-    std::vector<uint8_t> req = {0x7e, 3, 0x3f, 0x17,
-                              0x1c, 0, m}; // 3
+    frame<leds_mode_cmd, 2> req;
 
+    req.push(0);
+    req.push(m); // 3
     finish(port, req);
 }
 
-void set_telemetry_colors(LibSerial::SerialPort &port, led_set ctl, const std::vector<color_n> &set)
+void set_telemetry_colors(transport &port, led_set ctl, const std::vector<color_n> &set)
 {
-    const std::vector<uint8_t> head = { 0x7e, 0, 0x3f, 0x17, 0x19, ctl };
-    std::vector<std::vector<uint8_t> > req;
-    std::vector s = set;
-
-    // better have it sorted by led numbers
-    std::sort(s.begin(), s.end(), [](const auto &a, const auto &b)->bool {
-        return (a.first < b.first);
-    });
-
-    // form necessary number of requests containing max 5 items each
-    for (auto p = s.begin(); p < s.end();) {
-        auto t = head;
-        int j = 0;
-
-        for (; j < 5 && p < s.end(); ++j, ++p) {
-            t.push_back(p->first);
-
-            auto c = p->second.rgb();
+    telemetry_colors(port, ctl, set);
+}
 
-            t.push_back(uint8_t(std::get<0>(c)));
-            t.push_back(uint8_t(std::get<1>(c)));
-            t.push_back(uint8_t(std::get<2>(c)));
-        }
-        t[1] = (j * 4) + 2;
-        t.push_back(moza::chksum(t));
-        if (t.back() == 0x7e) t.push_back(0x7e);
+void send_telemetry(transport &port, led_set ctl, uint32_t mask)
+{
+    telemetry(port, ctl, mask);
+}
 
-        req.push_back(t);
-    }
+void set_telemetry_colors(batch &b, led_set ctl, const std::vector<color_n> &set)
+{
+    telemetry_colors(b, ctl, set);
+}
 
-    for (auto const &e: req) {
-        if (debug) debug_print(e);
+void send_telemetry(batch &b, led_set ctl, uint32_t mask)
+{
+    telemetry(b, ctl, mask);
+}
 
-        if (port.IsOpen()) {
-            port.FlushInputBuffer();
-            port.DrainWriteBuffer();
-            port.Write(e);
-        }
+void batch::append(const uint8_t *p, size_t size)
+{
+    if (m_size + size > capacity) flush(m_port, *this);
+    if (size > capacity) {
+        throw std::length_error("frame too long for a batch");
     }
+    std::copy_n(p, size, m_buf.begin() + m_size);
+    m_size += size;
+    ++m_frames;
 }
 
-void send_telemetry(LibSerial::SerialPort &port, led_set ctl, uint32_t mask)
+void flush(transport &port, batch &b, bool drain)
 {
-    std::vector<uint8_t> req = {0x7e, 6, 0x3f, 0x17, 0x1a, ctl,
-                                uint8_t(mask & 0xff), uint8_t(mask >> 8 & 0xff),
-                                uint8_t(mask >> 16 & 0xff), uint8_t(mask  >> 24 & 0xff)}; // 6
+    if (!b.empty()) wire.record(trace::TX, port.fd(), b.data(), b.size());
 
-    finish(port, req);
+    if (!b.empty() && port.is_open()) {
+        port.write(b.data(), b.size());
+        if (drain) port.drain();
+        metrics->frames.add(b.frames());
+        metrics->bytes.add(b.size());
+    }
+    b.clear();
 }
 
-mode get_leds_mode(LibSerial::SerialPort &port, led_set ctl)
+mode get_leds_mode(transport &port, led_set ctl)
 {
     std::vector<uint8_t> req = {0x7e, 3, 0x40, 0x17,
                                 0x1c, ctl, 0}; // 3
@@ -128,19 +170,18 @@ mode get_leds_mode(LibSerial::SerialPort &port, led_set ctl)
 
     uint8_t m = 0;
 
-    if (debug) debug_print(req);
-
-    if (port.IsOpen())  {
+    if (port.is_open())  {
         auto ans = get_reply(port, req);
 
-        if (debug)  debug_print(ans);
         m = ans[6];
+    } else {
+        trace_tx(port, req);
     }
     assert(m <= ON);
     return mode(m);
 }
 
-RGB get_led_color(LibSerial::SerialPort &port, led_set ctl, uint8_t n)
+RGB get_led_color(transport &port, led_set ctl, uint8_t n)
 {
     std::vector<uint8_t> req = {0x7e, 7, 0x40, 0x17, 0x1f, ctl, 0xff, n, 0, 0, 0};
 
@@ -149,13 +190,40 @@ RGB get_led_color(LibSerial::SerialPort &port, led_set ctl, uint8_t n)
 
     std::vector<uint8_t> ans = {0};
 
-    if (debug) debug_print(req);
-
-    if (port.IsOpen()) {
+    if (port.is_open()) {
         ans = get_reply(port, req);
-        if (debug)  debug_print(ans);
+    } else {
+        trace_tx(port, req);
     }
     return RGB(ans[8], ans[9], ans[10]);
 }
 
+std::vector<RGB> get_led_colors(transport &port, led_set ctl, uint8_t count)
+{
+    std::vector<std::vector<uint8_t> > reqs;
+
+    for (uint8_t n = 0; n < count; ++n) {
+        std::vector<uint8_t> req = {0x7e, 7, 0x40, 0x17, 0x1f, ctl, 0xff, n, 0, 0, 0};
+
+        req.push_back(moza::chksum(req));
+        if (req.back() == 0x7e) req.push_back(0x7e);
+        reqs.push_back(req);
+    }
+
+    std::vector<RGB> colors(count, RGB::black);
+
+    if (!port.is_open()) {
+        for (const auto &r: reqs) trace_tx(port, r);
+        return colors;
+    }
+
+    // up to the LED number
+    const auto ans = get_replies(port, reqs, 8);
+
+    for (uint8_t n = 0; n < count; ++n) {
+        colors[n] = RGB(ans[n][8], ans[n][9], ans[n][10]);
+    }
+    return colors;
+}
+
 } // namespace moza
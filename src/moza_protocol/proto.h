@@ -1,10 +1,11 @@
 #ifndef PROTO_H
 #define PROTO_H
 
+#include <array>
 #include <cstdint>
 #include <vector>
 #include <stdexcept>
-#include <libserial/SerialPort.h>
+#include "transport.h"
 #include "rgb.h"
 
 class NOK_error : public std::runtime_error {
@@ -14,26 +15,67 @@ explicit NOK_error(const std::string& whatArg [[maybe_unused]])
     {}
 };
 
+// no reply in time, as opposed to a NOK one
+class read_timeout : public NOK_error {
+public:
+    read_timeout() : NOK_error("ReadTimeout") {}
+};
+
 namespace moza {
 
 extern bool debug;
 
 using color_n = std::pair<uint8_t, RGB>;
 
+// LEDs are addressed by the bits of a 32-bit mask
+constexpr uint8_t max_leds = 32;
+
 enum led_set : uint8_t { RPM, BUTTON };
 enum mode : uint8_t { OFF, TELEMETRY, ON };
 
+// Frames queued to go out with a single write, to port; when a frame
+// doesn't fit any more, what is there is written first
+class batch {
+public:
+    static constexpr size_t capacity = 1024;
+
+    explicit batch(transport &port) : m_port(port) {}
+
+    void append(const uint8_t *p, size_t size);
+    void clear() { m_size = 0; m_frames = 0; }
+
+    bool empty() const { return m_size == 0; }
+    const uint8_t *data() const { return m_buf.data(); }
+    size_t size() const { return m_size; }
+    size_t frames() const { return m_frames; }
+
+private:
+    transport &m_port;
+    std::array<uint8_t, capacity> m_buf;
+    size_t m_size = 0;
+    size_t m_frames = 0;
+};
+
 uint8_t chksum(const std::vector<uint8_t>& data);
 
-RGB get_led_color(LibSerial::SerialPort &port, led_set ctl, uint8_t n);
-mode get_leds_mode(LibSerial::SerialPort &port, led_set ctl);
+RGB get_led_color(transport &port, led_set ctl, uint8_t n);
+// of LEDs 0 to count - 1, all requests sent at once
+std::vector<RGB> get_led_colors(transport &port, led_set ctl, uint8_t count);
+mode get_leds_mode(transport &port, led_set ctl);
+
+void set_led_color(transport &port, led_set ctl, uint8_t n, RGB color);
+void set_rpm_mode(transport &port, mode m); // doesn't work with buttons, they are always seem to be in telemetry mode
+void set_telemetry_colors(transport &port, led_set ctl, const std::vector<color_n> &set);
+void send_telemetry(transport &port, led_set ctl, uint32_t mask);
+
+// the same, queued to be sent by flush()
+void set_telemetry_colors(batch &b, led_set ctl, const std::vector<color_n> &set);
+void send_telemetry(batch &b, led_set ctl, uint32_t mask);
 
-void set_led_color(LibSerial::SerialPort &port, led_set ctl, uint8_t n, RGB color);
-void set_rpm_mode(LibSerial::SerialPort &port, mode m); // doesn't work with buttons, they are always seem to be in telemetry mode
-void set_telemetry_colors(LibSerial::SerialPort &port, led_set ctl, const std::vector<color_n> &set);
-void send_telemetry(LibSerial::SerialPort &port, led_set ctl, uint32_t mask);
-// void send_sync(LibSerial::SerialPort &port);
-// void send_idle_tel(LibSerial::SerialPort &port);
+// writes and clears the batch; waits for the data to be transmitted if drain is set
+void flush(transport &port, batch &b, bool drain = false);
+// void send_sync(transport &port);
+// void send_idle_tel(transport &port);
 
 }	// namespace moza
 
@@ -8,6 +8,7 @@ class RGB {
 public:
     using value_type = std::tuple<unsigned int, unsigned int, unsigned int>;
 
+    RGB() = default;
     RGB(unsigned int r, unsigned int g, unsigned int b) : m_r(r), m_g(g), m_b(b) {}
 
     [[nodiscard]] value_type rgb() const
@@ -19,6 +20,11 @@ public:
 	return rgb();
     }
 
+    bool operator==(const RGB &o) const {
+        return m_r == o.m_r && m_g == o.m_g && m_b == o.m_b;
+    }
+    bool operator!=(const RGB &o) const { return !(*this == o); }
+
     static RGB from_int(int n);
     static RGB from_name(const std::string& s);
 
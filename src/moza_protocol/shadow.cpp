@@ -0,0 +1,109 @@
+#include "shadow.h"
+#include "stats.h"
+
+#include <algorithm>
+
+namespace moza {
+
+shadow::shadow(unsigned int resync_ms)
+    : m_resync(std::chrono::milliseconds(resync_ms))
+{
+    for (auto &l: m_leds) l.synced = clock::now();
+    m_out.reserve(2 * max_leds);
+}
+
+void shadow::prefault()
+{
+    m_out.resize(m_out.capacity());
+    m_out.clear();
+}
+
+uint8_t shadow::tick()
+{
+    if (m_resync == clock::duration::zero()) return 0;
+
+    const auto now = clock::now();
+    uint8_t due = 0;
+
+    for (uint8_t i = 0; i < m_leds.size(); ++i) {
+        auto &l = m_leds[i];
+
+        if (now - l.synced >= m_resync) {
+            l.mask_known = false;
+            l.dirty = true;
+            l.synced = now;
+            due |= 1 << i;
+        }
+    }
+    return due;
+}
+
+int shadow::due_in_ms() const
+{
+    if (m_resync == clock::duration::zero()) return -1;
+
+    auto first = m_leds[0].synced;
+
+    for (const auto &l: m_leds) first = std::min(first, l.synced);
+
+    const auto left = first + m_resync - clock::now();
+
+    // rounded up, not to wake up just before
+    return std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(left).count());
+}
+
+bool shadow::set_telemetry_colors(batch &out, led_set ctl, const std::vector<color_n> &set)
+{
+    auto &l = m_leds.at(ctl);
+
+    m_out.clear();
+
+    for (const auto &c: set) {
+        const uint32_t bit = 1u << c.first;
+
+        if (l.dirty || !(l.colors_known & bit) || l.colors[c.first] != c.second) {
+            l.colors[c.first] = c.second;
+            l.colors_known |= bit;
+            m_out.push_back(c);
+        }
+    }
+
+    if (l.dirty) {
+        // resend the rest of what the device is supposed to show
+        uint32_t rest = l.colors_known;
+
+        for (const auto &c: m_out) rest &= ~(1u << c.first);
+        for (uint8_t n = 0; rest; ++n, rest >>= 1) {
+            if (rest & 1) m_out.push_back(std::make_pair(n, l.colors[n]));
+        }
+        l.dirty = false;
+    }
+
+    // 5 colors a frame
+    const size_t wanted = (set.size() + 4) / 5;
+    const size_t sent = (m_out.size() + 4) / 5;
+
+    if (wanted > sent) metrics->frames_suppressed.add(wanted - sent);
+
+    if (m_out.empty()) return false;
+
+    moza::set_telemetry_colors(out, ctl, m_out);
+    return true;
+}
+
+bool shadow::send_telemetry(batch &out, led_set ctl, uint32_t mask)
+{
+    auto &l = m_leds.at(ctl);
+
+    if (l.mask_known && l.mask == mask) {
+        metrics->frames_suppressed.add();
+        return false;
+    }
+
+    moza::send_telemetry(out, ctl, mask);
+    l.mask = mask;
+    l.mask_known = true;
+    return true;
+}
+
+}	// namespace moza
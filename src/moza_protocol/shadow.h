@@ -0,0 +1,56 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "proto.h"
+
+namespace moza {
+
+// A copy of what we believe the device currently shows, so that only the
+// differences go to the serial port. Every resync_ms (0 = never) all known
+// state is sent again, in case the device has lost or missed something.
+class shadow {
+public:
+    explicit shadow(unsigned int resync_ms = 0);
+
+    // forget everything that is due for a resync, returns those sets by
+    // bit; the latest state of each is to be sent again
+    uint8_t tick();
+
+    // until the next set is due, -1 if never
+    int due_in_ms() const;
+
+    // queue what differs, returns true if anything has been queued
+    bool set_telemetry_colors(batch &out, led_set ctl, const std::vector<color_n> &set);
+    bool send_telemetry(batch &out, led_set ctl, uint32_t mask);
+
+    // writes over what it has reserved, for the pages to be there already
+    void prefault();
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct leds {
+        uint32_t mask = 0;
+        bool mask_known = false;
+        bool dirty = false;                 // resend all known colors
+
+        std::array<RGB, max_leds> colors;
+        uint32_t colors_known = 0;          // bit per LED
+
+        clock::time_point synced;
+    };
+
+    std::array<leds, 2> m_leds;             // indexed by led_set
+    clock::duration m_resync;
+
+    std::vector<color_n> m_out;             // reused to avoid allocations
+};
+
+}	// namespace moza
+
+#endif // SHADOW_H
@@ -0,0 +1,51 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace moza {
+
+// Lock-free ring for exactly one producer thread and one consumer thread.
+// N must be a power of two.
+template <typename T, size_t N>
+class spsc_queue {
+    static_assert(N && !(N & (N - 1)), "queue size must be a power of two");
+
+public:
+    // false if the queue is full
+    bool push(const T &v)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head - m_tail.load(std::memory_order_acquire) == N) return false;
+
+        m_items[head & (N - 1)] = v;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // false if the queue is empty
+    bool pop(T &v)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (m_head.load(std::memory_order_acquire) == tail) return false;
+
+        v = m_items[tail & (N - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, N> m_items;
+
+    // on separate cache lines, as each is written by its own thread
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+};
+
+}	// namespace moza
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,47 @@
+#include "stats.h"
+#include <algorithm>
+
+namespace moza {
+
+namespace {
+
+stats local;
+
+} // namespace
+
+stats *metrics = &local;
+
+void histogram::record(int64_t ns)
+{
+    const uint64_t v = ns > 0? ns : 0;
+    const int k = v? 63 - __builtin_clzll(v) : 0;
+
+    m_buckets[k < buckets? k : buckets - 1].add();
+    m_count.add();
+    m_sum.add(v);
+
+    // mostly a single thread records any one histogram, this rarely loops
+    uint64_t m = m_max.load(std::memory_order_relaxed);
+
+    while (v > m && !m_max.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+}
+
+uint64_t histogram::quantile(double q) const
+{
+    uint64_t n[buckets];
+    uint64_t total = 0;
+
+    for (int k = 0; k < buckets; ++k) total += (n[k] = bucket(k));
+    if (!total) return 0;
+
+    const uint64_t rank = q * (total - 1);
+    uint64_t seen = 0;
+
+    for (int k = 0; k < buckets - 1; ++k) {
+        seen += n[k];
+        if (seen > rank) return std::min(uint64_t(2) << k, max());
+    }
+    return max();
+}
+
+}	// namespace moza
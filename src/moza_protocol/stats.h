@@ -0,0 +1,91 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace moza {
+
+// Only ever added to, from any thread, and read by another process. Relaxed,
+// nothing else is ordered by it.
+class counter {
+public:
+    void add(uint64_t n = 1) { m_v.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return m_v.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_v{0};
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "counters must work in shared memory");
+
+// Durations in ns, by powers of two: bucket k counts those in [2^k, 2^(k+1)).
+class histogram {
+public:
+    static constexpr int buckets = 33;          // the last one has 4.3 s and more
+
+    void record(int64_t ns);
+
+    uint64_t count() const { return m_count.get(); }
+    uint64_t sum() const { return m_sum.get(); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+    uint64_t bucket(int k) const { return m_buckets[k].get(); }
+
+    // the upper bound of the bucket the q-th quantile falls in, or the max
+    uint64_t quantile(double q) const;
+
+private:
+    counter m_count;
+    counter m_sum;
+    std::atomic<uint64_t> m_max{0};
+    counter m_buckets[buckets];
+};
+
+// Everything a running leds4sim counts about itself, laid out to be put in
+// a shared memory segment as is.
+struct stats {
+    static constexpr uint32_t magic_value = 0x5453344c;      // "L4ST"
+    static constexpr uint32_t layout_version = 3;
+
+    // real-time settings, by bit
+    enum rt_setting : uint32_t {
+        RT_PRIORITY = 1, RT_AFFINITY = 2, RT_SERIAL_PRIORITY = 4, RT_SERIAL_AFFINITY = 8,
+        RT_LOCK_MEMORY = 16, RT_PREFAULT = 32
+    };
+
+    uint32_t magic = 0;                         // set last, once it's all there
+    uint32_t layout = layout_version;
+    int64_t pid = 0;
+    int64_t started_ns = 0;                     // CLOCK_REALTIME
+
+    std::atomic<uint32_t> rt_requested{0};      // rt_setting bits
+    std::atomic<uint32_t> rt_applied{0};
+
+    counter cycles;
+    counter snapshots;                          // of the telemetry
+    counter snapshots_unchanged;                // nothing to evaluate
+    counter snapshots_torn;                     // the game kept writing during all tries
+    counter evaluations;
+    counter frames;                             // written to the devices
+    counter bytes;
+    counter frames_suppressed;                  // not sent, the device already shows that
+    counter changes_suppressed;                 // by hysteresis or hold times
+    counter states_dropped;                     // replaced by newer ones before written
+    counter nok_retries;
+    counter read_timeouts;
+    counter game_frames;                        // updates waited for, in sync with the game
+    counter game_frames_missed;                 // written over before they were seen
+
+    histogram cycle;                            // the work of a cycle, without the sleep
+    histogram evaluation;
+    histogram write;                            // from being posted to written
+};
+
+// Where everything is recorded. Memory of its own until it's published, so
+// recording never has to check.
+extern stats *metrics;
+
+}	// namespace moza
+
+#endif // STATS_H
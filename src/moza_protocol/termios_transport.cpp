@@ -0,0 +1,175 @@
+#include "termios_transport.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <linux/serial.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+
+namespace {
+
+std::runtime_error sys_error(const std::string &what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+namespace moza {
+
+termios_transport::termios_transport(const transport_options &opt)
+    : m_opt(opt)
+{
+}
+
+termios_transport::~termios_transport()
+{
+    close();
+}
+
+void termios_transport::close()
+{
+    if (m_epfd >= 0) ::close(m_epfd);
+    if (m_fd >= 0) ::close(m_fd);
+    m_epfd = m_fd = -1;
+}
+
+void termios_transport::open(const std::string &path)
+{
+    close();
+
+    m_fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (m_fd < 0) throw sys_error(path);
+
+    termios t;
+
+    if (tcgetattr(m_fd, &t) < 0) {
+        const auto e = sys_error(path);
+
+        close();
+        throw e;
+    }
+
+    // the device is USB CDC, the speed doesn't matter but has to be something
+    cfmakeraw(&t);
+    cfsetspeed(&t, B115200);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 0;
+    tcsetattr(m_fd, TCSANOW, &t);
+
+    if (m_opt.low_latency) {
+        serial_struct ss;
+
+        // only real UARTs have it, fine if it's not there
+        if (ioctl(m_fd, TIOCGSERIAL, &ss) == 0) {
+            ss.flags |= ASYNC_LOW_LATENCY;
+            ioctl(m_fd, TIOCSSERIAL, &ss);
+        }
+    }
+
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+
+    epoll_event ev = {};
+
+    ev.events = EPOLLIN;
+    if (m_epfd < 0 || epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_fd, &ev) < 0) {
+        const auto e = sys_error("epoll");
+
+        close();
+        throw e;
+    }
+}
+
+void termios_transport::wait_writable()
+{
+    pollfd p = {m_fd, POLLOUT, 0};
+
+    while (poll(&p, 1, -1) < 0) {
+        if (errno != EINTR) throw sys_error("serial poll failed");
+    }
+}
+
+void termios_transport::write(const uint8_t *p, size_t size)
+{
+    while (size > 0) {
+        const ssize_t n = ::write(m_fd, p, size);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                wait_writable();
+                continue;
+            }
+            throw sys_error("serial write failed");
+        }
+        p += n;
+        size -= n;
+    }
+}
+
+void termios_transport::write(const iovec *v, int n)
+{
+    // a copy to be adjusted after a partial write, rarely needed
+    std::vector<iovec> rest;
+
+    while (n > 0) {
+        ssize_t done = writev(m_fd, v, n);
+
+        if (done < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                wait_writable();
+                continue;
+            }
+            throw sys_error("serial write failed");
+        }
+
+        while (n > 0 && size_t(done) >= v->iov_len) {
+            done -= v->iov_len;
+            ++v;
+            --n;
+        }
+        if (n > 0 && done > 0) {
+            if (rest.empty()) {
+                rest.assign(v, v + n);
+                v = rest.data();
+            }
+
+            iovec *first = &rest[v - rest.data()];
+
+            first->iov_base = static_cast<uint8_t*>(first->iov_base) + done;
+            first->iov_len -= done;
+        }
+    }
+}
+
+bool termios_transport::wait_readable(int timeout_ms)
+{
+    epoll_event ev;
+
+    for (;;) {
+        const int n = epoll_wait(m_epfd, &ev, 1, timeout_ms);
+
+        if (n >= 0) return n > 0;
+        if (errno != EINTR) throw sys_error("epoll_wait");
+    }
+}
+
+void termios_transport::flush_input()
+{
+    tcflush(m_fd, TCIFLUSH);
+}
+
+void termios_transport::drain()
+{
+    while (tcdrain(m_fd) < 0 && errno == EINTR) {}
+}
+
+}	// namespace moza
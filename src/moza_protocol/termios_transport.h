@@ -0,0 +1,41 @@
+#ifndef TERMIOS_TRANSPORT_H
+#define TERMIOS_TRANSPORT_H
+
+#include "transport.h"
+
+namespace moza {
+
+// Straight on the tty fd: raw mode, non-blocking, waits through epoll.
+// Nothing is copied on the way and no call throws unless it fails.
+class termios_transport : public transport {
+public:
+    explicit termios_transport(const transport_options &opt = transport_options());
+    ~termios_transport() override;
+
+    termios_transport(const termios_transport&) = delete;
+    termios_transport& operator=(const termios_transport&) = delete;
+
+    void open(const std::string &path) override;
+    bool is_open() const override { return m_fd >= 0; }
+    int fd() const override { return m_fd; }
+
+    void write(const uint8_t *p, size_t size) override;
+    void write(const iovec *v, int n) override;
+
+    bool wait_readable(int timeout_ms) override;
+
+    void flush_input() override;
+    void drain() override;
+
+private:
+    void wait_writable();
+    void close();
+
+    transport_options m_opt;
+    int m_fd = -1;
+    int m_epfd = -1;
+};
+
+}	// namespace moza
+
+#endif // TERMIOS_TRANSPORT_H
@@ -0,0 +1,89 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace moza {
+
+trace wire;
+
+void trace::record(direction d, int fd, const uint8_t *p, size_t size)
+{
+    const int64_t t = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    do {
+        const size_t n = std::min(size, chunk);
+        const uint64_t i = m_head.fetch_add(1, std::memory_order_relaxed);
+        entry &e = m_ring[i & (entries - 1)];
+
+        // a reader seeing it in between skips it
+        e.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        e.t_ns = t;
+        e.dir = d;
+        e.size = n;
+        e.fd = fd;
+        std::memcpy(e.data, p, n);
+        e.seq.store(i + 1, std::memory_order_release);
+
+        p += n;
+        size -= n;
+    } while (size > 0);
+}
+
+void trace::record(direction d, int fd, const iovec *v, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        if (v[i].iov_len) record(d, fd, static_cast<const uint8_t*>(v[i].iov_base), v[i].iov_len);
+    }
+}
+
+void trace::dump(const std::string &fname) const
+{
+    std::ofstream f(fname, std::ios::binary | std::ios::trunc);
+    std::vector<char> out;
+
+    auto put = [&out](const void *p, size_t size) {
+        const char *c = static_cast<const char*>(p);
+
+        out.insert(out.end(), c, c + size);
+    };
+
+    put(&magic, sizeof(magic));
+    put(&version, sizeof(version));
+
+    const uint64_t head = m_head.load(std::memory_order_acquire);
+
+    for (uint64_t i = head > entries? head - entries : 0; i < head; ++i) {
+        const entry &e = m_ring[i & (entries - 1)];
+
+        // only if it wasn't being written while copied
+        if (e.seq.load(std::memory_order_acquire) != i + 1) continue;
+
+        const int64_t t = e.t_ns;
+        const uint8_t dir = e.dir;
+        const int16_t fd = e.fd;
+        const uint8_t size = std::min<uint8_t>(e.size, chunk);
+        uint8_t data[chunk];
+
+        std::memcpy(data, e.data, size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (e.seq.load(std::memory_order_relaxed) != i + 1) continue;
+
+        put(&t, sizeof(t));
+        put(&dir, sizeof(dir));
+        put(&fd, sizeof(fd));
+        put(&size, sizeof(size));
+        put(data, size);
+    }
+
+    f.write(out.data(), out.size());
+    if (!f) throw std::runtime_error("can't write the trace to " + fname);
+}
+
+}	// namespace moza
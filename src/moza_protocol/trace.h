@@ -0,0 +1,58 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <sys/uio.h>
+
+namespace moza {
+
+// The bytes written to and read from the devices, as they went over the
+// wire, with the time and the fd. The latest ones are kept in a ring in
+// memory, recorded from any thread without locking, cheap enough to be
+// always on. They're written to a file only when asked to, and decoded by
+// moza-trace.
+//
+// The file: "L4TR", a 32-bit version, then a record per entry, oldest
+// first: time in ns (steady clock, 64 bits), direction, fd (16 bits), size,
+// and that many bytes; all little-endian. Longer writes and reads take
+// several entries, the frames in them are split again by the decoder.
+class trace {
+public:
+    static constexpr uint32_t magic = 0x5254344c;       // "L4TR"
+    static constexpr uint32_t version = 1;
+    static constexpr size_t entries = 8192;             // a power of 2
+    static constexpr size_t chunk = 44;                 // bytes an entry
+
+    enum direction : uint8_t { TX, RX };
+
+    void record(direction d, int fd, const uint8_t *p, size_t size);
+    void record(direction d, int fd, const iovec *v, int n);
+
+    // throws std::runtime_error if the file can't be written
+    void dump(const std::string &fname) const;
+
+private:
+    struct entry {
+        std::atomic<uint64_t> seq{0};   // its place in the sequence + 1, 0 while written
+        int64_t t_ns;
+        uint8_t dir;
+        uint8_t size;
+        int16_t fd;
+        uint8_t data[chunk];
+    };
+    static_assert(sizeof(entry) == 64, "an entry should take a cache line");
+
+    std::atomic<uint64_t> m_head{0};
+    std::array<entry, entries> m_ring;
+};
+
+extern trace wire;
+
+}	// namespace moza
+
+#endif // TRACE_H
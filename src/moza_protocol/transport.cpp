@@ -0,0 +1,17 @@
+#include "transport.h"
+#include <stdexcept>
+
+#include "termios_transport.h"
+#include "libserial_transport.h"
+
+namespace moza {
+
+std::unique_ptr<transport> make_transport(const std::string &backend, const transport_options &opt)
+{
+    if (backend == "native")    return std::make_unique<termios_transport>(opt);
+    if (backend == "libserial") return std::make_unique<libserial_transport>();
+
+    throw std::runtime_error("unknown serial backend \"" + backend + "\"");
+}
+
+}	// namespace moza
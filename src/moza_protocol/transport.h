@@ -0,0 +1,47 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <sys/uio.h>
+
+namespace moza {
+
+struct transport_options {
+    bool low_latency = true;        // no driver buffering delay, if it has that
+};
+
+// The serial line to the device. Writes go out whole or throw; reading is
+// done from fd() with a parser once wait_readable() says so. Until opened,
+// nothing is supposed to be written to it (like with --no-wheel).
+class transport {
+public:
+    virtual ~transport() = default;
+
+    virtual void open(const std::string &path) = 0;
+    virtual bool is_open() const = 0;
+    virtual int fd() const = 0;
+
+    virtual void write(const uint8_t *p, size_t size) = 0;
+    // one write of all the pieces, if it can
+    virtual void write(const iovec *v, int n) = 0;
+
+    // false on timeout
+    virtual bool wait_readable(int timeout_ms) = 0;
+
+    // drop what has been received and not read
+    virtual void flush_input() = 0;
+    // wait until all written is transmitted
+    virtual void drain() = 0;
+};
+
+// "native" for raw non-blocking termios with epoll, "libserial" for LibSerial
+std::unique_ptr<transport> make_transport(const std::string &backend,
+                                          const transport_options &opt = transport_options());
+
+}	// namespace moza
+
+#endif // TRANSPORT_H
@@ -0,0 +1,183 @@
+#include "writer.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+namespace moza {
+
+namespace {
+
+int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// writes back a byte of every page it spans
+void touch(void *p, size_t size)
+{
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    auto *b = static_cast<volatile uint8_t*>(p);
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(p);
+
+    for (uintptr_t a = begin; a < begin + size; a = (a & ~(page - 1)) + page) {
+        const uint8_t v = b[a - begin];
+
+        b[a - begin] = v;
+    }
+}
+
+} // namespace
+
+writer::writer(transport &port, shadow &&wheel)
+    : m_port(port), m_wheel(std::move(wheel)), m_out(port), m_efd(eventfd(0, EFD_CLOEXEC))
+{
+    if (m_efd < 0) {
+        throw std::runtime_error(std::string("eventfd: ") + std::strerror(errno));
+    }
+    m_colors.reserve(max_leds);
+    m_thread = std::thread(&writer::run, this);
+}
+
+writer::~writer()
+{
+    m_stop.store(true);
+    post();
+    m_thread.join();
+    close(m_efd);
+}
+
+void writer::prefault()
+{
+    // the queue, the pending and overflow states, the batch, the shadow
+    touch(this, sizeof(*this));
+    m_colors.resize(m_colors.capacity());
+    m_colors.clear();
+    m_wheel.prefault();
+}
+
+void writer::submit(led_set ctl, uint32_t mask, const std::vector<color_n> &colors)
+{
+    if (m_failed.load(std::memory_order_acquire)) {
+        std::rethrow_exception(m_error);
+    }
+
+    auto &s = m_pending.at(ctl);
+
+    s.ctl = ctl;
+    s.mask = mask;
+    s.n_colors = std::min(colors.size(), s.colors.size());
+    std::copy_n(colors.begin(), s.n_colors, s.colors.begin());
+    s.seq = ++m_seq;
+    m_pending_bits |= 1 << ctl;
+}
+
+void writer::post()
+{
+    for (uint8_t i = 0; i < m_pending.size(); ++i) {
+        if (!(m_pending_bits & 1 << i)) continue;
+
+        // the thread is behind; it takes this one the next time it wakes up,
+        // that is right after the write below
+        if (!m_queue.push(m_pending[i])) {
+            auto &o = m_overflow[i];
+
+            o.states[o.back] = m_pending[i];
+            o.back = o.middle.exchange(o.back | overflow::fresh, std::memory_order_acq_rel) & ~overflow::fresh;
+        }
+    }
+    m_pending_bits = 0;
+
+    const uint64_t one = 1;
+
+    m_posted.store(now_ns(), std::memory_order_relaxed);
+    while (write(m_efd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+}
+
+void writer::run()
+{
+    std::array<leds_state, 2> latest;
+    std::array<uint64_t, 2> sent = {0, 0};
+
+    for (;;) {
+        // wakes up for a resync too, the telemetry may not change for a while
+        pollfd p = {m_efd, POLLIN, 0};
+        const int ready = poll(&p, 1, m_wheel.due_in_ms());
+
+        if (ready < 0 && errno == EINTR) continue;
+
+        uint64_t n;
+
+        if (ready > 0 && read(m_efd, &n, sizeof(n)) < 0 && errno == EINTR) continue;
+
+        // what has been queued before stopping still goes out
+        const bool stopping = m_stop.load();
+
+        // older states of the same set are stale, skip them; one queued
+        // before an overflow may only be popped after it
+        uint8_t got = 0;
+
+        auto take = [&](const leds_state &s) {
+            const bool have = got & 1 << s.ctl;
+            const uint64_t newest = have? latest[s.ctl].seq : sent[s.ctl];
+
+            if (have || s.seq <= newest) metrics->states_dropped.add();
+            if (s.seq <= newest) return;
+            latest.at(s.ctl) = s;
+            got |= 1 << s.ctl;
+        };
+
+        for (leds_state s; m_queue.pop(s);) take(s);
+
+        for (auto &o: m_overflow) {
+            if (!(o.middle.load(std::memory_order_relaxed) & overflow::fresh)) continue;
+            o.front = o.middle.exchange(o.front, std::memory_order_acq_rel) & ~overflow::fresh;
+            take(o.states[o.front]);
+        }
+
+        try {
+            // the last state sent is sent again, whatever the device has missed
+            const uint8_t due = m_wheel.tick();
+
+            for (uint8_t i = 0; i < latest.size(); ++i) {
+                if (!(got & 1 << i) && !(due & 1 << i && sent[i])) continue;
+                send(latest[i]);
+                sent[i] = latest[i].seq;
+            }
+            flush(m_port, m_out);
+        } catch (...) {
+            m_error = std::current_exception();
+            m_failed.store(true, std::memory_order_release);
+            break;
+        }
+
+        // averaged over the last 8 or so
+        if (got) {
+            const int64_t t = now_ns() - m_posted.load(std::memory_order_relaxed);
+            const int64_t l = m_latency.load(std::memory_order_relaxed);
+
+            m_latency.store(l? l + (t - l) / 8 : t, std::memory_order_relaxed);
+            metrics->write.record(t);
+        }
+
+        if (stopping) break;
+    }
+}
+
+void writer::send(const leds_state &s)
+{
+    m_colors.assign(s.colors.begin(), s.colors.begin() + s.n_colors);
+
+    m_wheel.set_telemetry_colors(m_out, s.ctl, m_colors);
+    m_wheel.send_telemetry(m_out, s.ctl, s.mask);
+}
+
+}	// namespace moza
@@ -0,0 +1,100 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <thread>
+#include <vector>
+#include "transport.h"
+
+#include "proto.h"
+#include "shadow.h"
+#include "spsc_queue.h"
+
+namespace moza {
+
+// LED state of one set, as the evaluation loop wants it shown
+struct leds_state {
+    led_set ctl = RPM;
+    uint32_t mask = 0;
+    uint8_t n_colors = 0;
+    std::array<color_n, max_leds> colors;
+    uint64_t seq = 0;                           // newer states have higher
+};
+
+// Writes LED states to the port in its own thread, so that the telemetry
+// loop never waits for the serial I/O. If the port falls behind, only the
+// latest state of each LED set is sent. A state that doesn't fit in the
+// queue is left for the thread in a per-set slot instead, so none is
+// stranded waiting for the next post(). When the shadow's resync is due, the thread
+// sends the last state of each set again by itself.
+class writer {
+public:
+    // the shadow should describe what the device shows at this point
+    writer(transport &port, shadow &&wheel);
+    ~writer();
+
+    writer(const writer&) = delete;
+    writer& operator=(const writer&) = delete;
+
+    // never blocks; rethrows here if writing in the thread has failed
+    void submit(led_set ctl, uint32_t mask, const std::vector<color_n> &colors);
+
+    // wake the thread to send what has been submitted
+    void post();
+
+    // how long it has taken on average from post() until the frames are
+    // written, 0 until something is
+    int64_t latency_ns() const { return m_latency.load(std::memory_order_relaxed); }
+
+    // of the thread, to set its scheduling
+    std::thread::native_handle_type native_handle() { return m_thread.native_handle(); }
+
+    // writes over every buffer the states pass through, so that none of
+    // their pages is faulted in on the way; only before the first post(),
+    // while the thread has nothing to work on
+    void prefault();
+
+private:
+    void run();
+    void send(const leds_state &s);
+
+    transport &m_port;
+    shadow m_wheel;
+    batch m_out;
+    std::vector<color_n> m_colors;
+
+    spsc_queue<leds_state, 16> m_queue;
+    // submitted, to be queued by post(); producer only
+    std::array<leds_state, 2> m_pending;
+    uint8_t m_pending_bits = 0;
+    uint64_t m_seq = 0;
+
+    // what didn't fit in the queue, by set: a triple buffer where the newest
+    // state replaces one the thread hasn't taken yet, no lock either side
+    struct overflow {
+        static constexpr uint8_t fresh = 0x80;
+
+        std::array<leds_state, 3> states;
+        uint8_t back = 0;                       // producer's
+        std::atomic<uint8_t> middle{1};         // | fresh until taken
+        uint8_t front = 2;                      // the thread's
+    };
+    std::array<overflow, 2> m_overflow;
+
+    std::atomic<int64_t> m_posted{0};           // steady_clock ns
+    std::atomic<int64_t> m_latency{0};
+
+    int m_efd;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_failed{false};
+    std::exception_ptr m_error;
+
+    std::thread m_thread;
+};
+
+}	// namespace moza
+
+#endif // WRITER_H
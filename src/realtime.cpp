@@ -0,0 +1,92 @@
+#include "realtime.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <alloca.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace realtime {
+
+bool set_priority(pthread_t t, int priority, const std::string &what)
+{
+    sched_param p{};
+
+    p.sched_priority = priority;
+
+    const int err = pthread_setschedparam(t, priority? SCHED_FIFO : SCHED_OTHER, &p);
+
+    if (err) {
+        std::cerr << "Can't run " << what << " at real-time priority " << priority << ": "
+                  << std::strerror(err) << std::endl;
+    }
+    return !err;
+}
+
+bool set_affinity(pthread_t t, const std::vector<int> &cpus, const std::string &what)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    for (int c: cpus) {
+        if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &set);
+    }
+
+    const int err = pthread_setaffinity_np(t, sizeof(set), &set);
+
+    if (err) {
+        std::cerr << "Can't pin " << what << " to the CPUs given: " << std::strerror(err) << std::endl;
+    }
+    return !err;
+}
+
+std::vector<int> affinity(pthread_t t)
+{
+    cpu_set_t set;
+    std::vector<int> cpus;
+
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(t, sizeof(set), &set) != 0) return cpus;
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (CPU_ISSET(c, &set)) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+bool lock_memory()
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        std::cerr << "Can't lock the memory: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void prefault(const volatile void *p, size_t size, bool writable)
+{
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    auto *b = static_cast<volatile uint8_t*>(const_cast<volatile void*>(p));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(p);
+
+    // from the start of each page after the first, so that the last one is
+    // reached even if p isn't aligned
+    for (uintptr_t a = begin; a < begin + size; a = (a & ~(page - 1)) + page) {
+        const uint8_t v = b[a - begin];
+
+        if (writable) b[a - begin] = v;
+    }
+}
+
+void prefault_stack(size_t size)
+{
+    volatile uint8_t *p = static_cast<volatile uint8_t*>(alloca(size));
+    const size_t page = sysconf(_SC_PAGESIZE);
+
+    // nothing there yet to write back
+    for (size_t i = 0; i < size; i += page) p[i] = 0;
+}
+
+} // namespace realtime
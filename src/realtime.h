@@ -0,0 +1,33 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+// Running ahead of a game that keeps every core busy: SCHED_FIFO, CPU
+// affinity, and no page faults in the loop. Each of these returns whether
+// it has been applied, printing why if not; usually it's the privileges
+// (CAP_SYS_NICE, RLIMIT_RTPRIO, RLIMIT_MEMLOCK).
+namespace realtime {
+
+// of the thread, priority 1 to 99, or 0 for the normal policy
+bool set_priority(pthread_t t, int priority, const std::string &what);
+bool set_affinity(pthread_t t, const std::vector<int> &cpus, const std::string &what);
+// the CPUs it may run on now
+std::vector<int> affinity(pthread_t t);
+
+// everything mapped, now and later, stays in memory
+bool lock_memory();
+
+// touches every page of it, writing back what's there if it's writable
+void prefault(const volatile void *p, size_t size, bool writable);
+
+// a stack of this size for the calling thread, faulted in beforehand
+void prefault_stack(size_t size = 256 * 1024);
+
+} // namespace realtime
+
+#endif // REALTIME_H
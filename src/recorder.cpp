@@ -0,0 +1,220 @@
+#include "recorder.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const char magic[8] = {'L', '4', 'S', 'R', 'E', 'C', '1', 0};
+
+// a few equal bytes between changes are cheaper to repeat than a new run
+const size_t max_gap = 4;
+
+void put_varint(std::vector<uint8_t> &v, uint64_t n)
+{
+    while (n >= 0x80) {
+        v.push_back(uint8_t(n) | 0x80);
+        n >>= 7;
+    }
+    v.push_back(uint8_t(n));
+}
+
+bool get_varint(std::istream &s, uint64_t &n)
+{
+    n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const int c = s.get();
+
+        if (c == EOF) return false;
+        n |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    throw std::runtime_error("corrupt recording");
+}
+
+uint64_t get_varint(std::istream &s)
+{
+    uint64_t n;
+
+    if (!get_varint(s, n)) throw std::runtime_error("truncated recording");
+    return n;
+}
+
+} // namespace
+
+recorder::recorder(const std::string &fname, const snapshot &snap)
+    : m_file(fname, std::ios::binary | std::ios::trunc), m_snap(snap),
+      m_spans(snap.spans().spans()), m_prev(snap.spans().bytes(), 0),
+      m_cur(snap.spans().bytes()), m_last(clock::now())
+{
+    if (!m_file) throw std::runtime_error("can't write " + fname);
+
+    for (const auto &s: m_spans) m_local.push_back(snap.local(s.offset));
+
+    std::vector<uint8_t> h(magic, magic + sizeof(magic));
+
+    put_varint(h, m_spans.size());
+    for (const auto &s: m_spans) {
+        put_varint(h, s.offset);
+        put_varint(h, s.size);
+    }
+    m_file.write((const char*)h.data(), h.size());
+
+    // runs are more than max_gap apart, their varints add 20 bytes at most
+    m_body.reserve(m_cur.size() * 5 + 32);
+    m_rec.reserve(m_body.capacity() + 20);
+}
+
+void recorder::record()
+{
+    size_t pos = 0;
+
+    for (size_t i = 0; i < m_spans.size(); ++i) {
+        std::memcpy(&m_cur[pos], m_snap.data() + m_local[i], m_spans[i].size);
+        pos += m_spans[i].size;
+    }
+
+    // runs of changed bytes, positions relative to the end of the previous run
+    const size_t n = m_cur.size();
+    size_t runs = 0;
+    size_t end = 0;
+
+    m_body.clear();
+    for (size_t i = 0; i < n;) {
+        if (m_cur[i] == m_prev[i]) {
+            ++i;
+            continue;
+        }
+
+        // over the changed bytes and short gaps of the same ones
+        size_t last = i + 1;
+
+        for (size_t j = last; j < n && j - last <= max_gap; ++j) {
+            if (m_cur[j] != m_prev[j]) last = j + 1;
+        }
+
+        put_varint(m_body, i - end);
+        put_varint(m_body, last - i);
+        m_body.insert(m_body.end(), m_cur.begin() + i, m_cur.begin() + last);
+        ++runs;
+        end = i = last;
+    }
+
+    if (runs == 0) return;
+
+    const auto now = clock::now();
+
+    m_rec.clear();
+    put_varint(m_rec, std::chrono::duration_cast<std::chrono::microseconds>(now - m_last).count());
+    put_varint(m_rec, runs);
+    m_rec.insert(m_rec.end(), m_body.begin(), m_body.end());
+    m_file.write((const char*)m_rec.data(), m_rec.size());
+
+    m_last = now;
+    m_prev.swap(m_cur);
+}
+
+replayer::replayer(const std::string &fname, size_t size)
+    : m_file(fname, std::ios::binary), m_image(size, 0)
+{
+    if (!m_file) throw std::runtime_error("can't read " + fname);
+
+    char h[sizeof(magic)];
+
+    if (!m_file.read(h, sizeof(h)) || std::memcmp(h, magic, sizeof(magic)) != 0) {
+        throw std::runtime_error(fname + " is not a telemetry recording");
+    }
+
+    size_t total = 0;
+
+    for (uint64_t n = get_varint(m_file); n > 0; --n) {
+        const uint64_t offset = get_varint(m_file);
+        const uint64_t sz = get_varint(m_file);
+
+        // not offset + sz, that may wrap around
+        if (sz > size || offset > size - sz) {
+            throw std::runtime_error("recording doesn't fit into mmap_size");
+        }
+        m_spans.push_back({uint32_t(offset), uint32_t(sz)});
+        total += sz;
+    }
+    m_flat.assign(total, 0);
+
+    read_next();
+}
+
+bool replayer::read_next()
+{
+    uint64_t dt;
+
+    m_has_next = get_varint(m_file, dt);
+    if (!m_has_next) return false;
+
+    m_next_us += dt;
+    m_next_runs.clear();
+    m_next_bytes.clear();
+
+    for (uint64_t runs = get_varint(m_file); runs > 0; --runs) {
+        const uint64_t skip = get_varint(m_file);
+        const uint64_t size = get_varint(m_file);
+        const size_t at = m_next_bytes.size();
+
+        if (size > m_flat.size()) throw std::runtime_error("corrupt recording");
+        m_next_runs.push_back({skip, size});
+        m_next_bytes.resize(at + size);
+        if (!m_file.read((char*)&m_next_bytes[at], size)) {
+            throw std::runtime_error("truncated recording");
+        }
+    }
+    return true;
+}
+
+void replayer::apply()
+{
+    size_t pos = 0;
+    const uint8_t *p = m_next_bytes.data();
+
+    for (const auto &r: m_next_runs) {
+        if (r.first > m_flat.size() - pos || r.second > m_flat.size() - pos - r.first) {
+            throw std::runtime_error("corrupt recording");
+        }
+        pos += r.first;
+        std::copy_n(p, r.second, &m_flat[pos]);
+        p += r.second;
+        pos += r.second;
+    }
+
+    // back to where they belong
+    pos = 0;
+    for (const auto &s: m_spans) {
+        std::copy_n(&m_flat[pos], s.size, &m_image[s.offset]);
+        pos += s.size;
+    }
+}
+
+bool replayer::advance(double speed)
+{
+    if (!m_started) {
+        m_start = clock::now();
+        m_started = true;
+    }
+
+    bool applied = false;
+
+    if (speed <= 0) {
+        if (m_has_next) {
+            apply();
+            read_next();
+            applied = true;
+        }
+    } else {
+        const double now_us = std::chrono::duration<double, std::micro>(clock::now() - m_start).count() * speed;
+
+        while (m_has_next && m_next_us <= now_us) {
+            apply();
+            read_next();
+            applied = true;
+        }
+    }
+    return applied || m_has_next;
+}
@@ -0,0 +1,74 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+#include "spans.h"
+#include "snapshot.h"
+
+// Telemetry recording: a header with the recorded spans, then a record for
+// every cycle the spans have changed in. A record is the time since the
+// previous one and the runs of bytes that differ from it, all numbers are
+// LEB128 varints.
+
+class recorder {
+public:
+    // records the spans of snap
+    recorder(const std::string &fname, const snapshot &snap);
+
+    // call every cycle after taking the snapshot, writes only if anything has changed
+    void record();
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    std::ofstream m_file;
+    const snapshot &m_snap;
+    std::vector<uint32_t> m_local;      // of each span in the snapshot
+    std::vector<span_set::span> m_spans;
+    std::vector<uint8_t> m_prev;
+    std::vector<uint8_t> m_cur;
+    std::vector<uint8_t> m_body;
+    std::vector<uint8_t> m_rec;
+    clock::time_point m_last;
+};
+
+class replayer {
+public:
+    // size of the telemetry image to be fed to the indicators
+    replayer(const std::string &fname, size_t size);
+
+    // Applies the records that are due at speed times the recorded pace,
+    // or just the next one if speed is 0. Returns false when there's nothing
+    // left to replay.
+    bool advance(double speed);
+
+    const volatile uint8_t *data() const { return m_image.data(); }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    bool read_next();
+    void apply();
+
+    std::ifstream m_file;
+    std::vector<span_set::span> m_spans;
+    std::vector<uint8_t> m_image;
+    std::vector<uint8_t> m_flat;        // the spans one after another
+
+    // the record read ahead
+    bool m_has_next = false;
+    uint64_t m_next_us = 0;             // since the beginning
+    std::vector<std::pair<uint64_t, uint64_t> > m_next_runs; // skipped, size
+    std::vector<uint8_t> m_next_bytes;
+
+    bool m_started = false;
+    clock::time_point m_start;
+};
+
+#endif // RECORDER_H
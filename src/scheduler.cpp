@@ -0,0 +1,115 @@
+#include "scheduler.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+namespace {
+
+constexpr int64_t NS = 1000000000;
+
+int64_t ns(const timespec &t)
+{
+    return t.tv_sec * NS + t.tv_nsec;
+}
+
+timespec from_ns(int64_t n)
+{
+    return {time_t(n / NS), long(n % NS)};
+}
+
+} // namespace
+
+scheduler::scheduler(unsigned int period_ms)
+    : m_period_ms(period_ms), m_fd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC))
+{
+    if (m_fd < 0) {
+        throw std::runtime_error(std::string("timerfd: ") + std::strerror(errno));
+    }
+    if (period_ms == 0) {
+        close(m_fd);
+        throw std::runtime_error("cycle period must not be 0");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &m_start);
+
+    try {
+        arm(1);
+    } catch (...) {
+        close(m_fd);
+        throw;
+    }
+}
+
+// on the same grid of deadlines, the first one n periods after the last wake up
+void scheduler::arm(unsigned int n)
+{
+    const int64_t period = int64_t(m_period_ms) * 1000000;
+    const itimerspec t = {from_ns(n * period), from_ns(ns(m_start) + int64_t(m_tick + n) * period)};
+
+    if (timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &t, nullptr) < 0) {
+        throw std::runtime_error(std::string("timerfd_settime: ") + std::strerror(errno));
+    }
+    m_every = n;
+}
+
+void scheduler::restart()
+{
+    clock_gettime(CLOCK_MONOTONIC, &m_start);
+    m_tick = m_prev = 0;
+    arm(m_every);
+}
+
+scheduler::~scheduler()
+{
+    close(m_fd);
+}
+
+void scheduler::wait(unsigned int n, int fd)
+{
+    uint64_t expired = 0;
+
+    if (n == 0) n = 1;
+    if (n != m_every) arm(n);
+
+    if (fd >= 0) {
+        pollfd p[2] = {{m_fd, POLLIN, 0}, {fd, POLLIN, 0}};
+
+        while (poll(p, 2, -1) < 0) {
+            if (errno != EINTR) {
+                throw std::runtime_error(std::string("poll: ") + std::strerror(errno));
+            }
+        }
+        if (!(p[0].revents & POLLIN)) {
+            m_prev = m_tick;
+            return;
+        }
+    }
+
+    // a signal only delays it, the deadline stays where it was
+    while (read(m_fd, &expired, sizeof(expired)) < 0) {
+        if (errno != EINTR) {
+            throw std::runtime_error(std::string("timerfd: ") + std::strerror(errno));
+        }
+    }
+
+    timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    m_prev = m_tick;
+    m_tick += expired * m_every;
+
+    const int64_t deadline = ns(m_start) + int64_t(m_tick) * m_period_ms * 1000000;
+    const int64_t late = ns(now) - deadline;
+
+    if (m_stats.cycles == 0 || late < m_stats.late_min_ns) m_stats.late_min_ns = late;
+    if (m_stats.cycles == 0 || late > m_stats.late_max_ns) m_stats.late_max_ns = late;
+    m_stats.late_sum_ns += late;
+    m_stats.overruns += expired - 1;
+    ++m_stats.cycles;
+}
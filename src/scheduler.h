@@ -0,0 +1,60 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <ctime>
+
+// Wakes up on a fixed grid of absolute deadlines (a periodic timerfd on the
+// monotonic clock), so the period doesn't stretch by however long a cycle
+// takes and errors don't add up. A cycle that takes longer than the period
+// skips the deadlines it has missed instead of running late ones back to
+// back; these are counted as overruns.
+class scheduler {
+public:
+    struct counters {
+        uint64_t cycles = 0;
+        uint64_t overruns = 0;          // deadlines missed
+        int64_t late_min_ns = 0;        // woken up after the deadline
+        int64_t late_max_ns = 0;
+        int64_t late_sum_ns = 0;
+    };
+
+    explicit scheduler(unsigned int period_ms);
+    ~scheduler();
+
+    scheduler(const scheduler&) = delete;
+    scheduler& operator=(const scheduler&) = delete;
+
+    // sleep until the next deadline, or the one n periods after the last
+    // wake up, for running slower for a while; or until fd is readable, which
+    // ends no period and leaves the deadline where it was
+    void wait(unsigned int n = 1, int fd = -1);
+
+    // start the grid over from now, after not waiting on it for a while,
+    // instead of counting the deadlines passed meanwhile as missed
+    void restart();
+
+    // count a period without waiting, for running as fast as possible
+    void step() { m_prev = m_tick++; }
+
+    // if a task running every n periods is due in this one
+    bool due(unsigned int n) const { return m_tick / n != m_prev / n || m_tick == 0; }
+
+    unsigned int period_ms() const { return m_period_ms; }
+    const counters &stats() const { return m_stats; }
+
+private:
+    void arm(unsigned int n);
+
+    unsigned int m_period_ms;
+    unsigned int m_every = 1;           // periods the timer is armed for
+    int m_fd;
+
+    timespec m_start;
+    uint64_t m_tick = 0;                // periods since the start
+    uint64_t m_prev = 0;                // at the previous wake up
+
+    counters m_stats;
+};
+
+#endif // SCHEDULER_H
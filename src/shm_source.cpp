@@ -0,0 +1,147 @@
+#include "shm_source.h"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::runtime_error sys_error(const std::string &what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+shm_source::shm_source(const std::string &fname, size_t size)
+    : m_fname(fname), m_size(size), m_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+    if (m_fd < 0) throw sys_error("inotify");
+
+    watch();
+    update();
+}
+
+shm_source::~shm_source()
+{
+    unmap();
+    close(m_fd);
+}
+
+// the directory of the file, or the closest existing one above it
+void shm_source::watch()
+{
+    fs::path dir = fs::absolute(m_fname).parent_path();
+    std::error_code ec;
+
+    while (!fs::is_directory(dir, ec) && dir.has_relative_path()) {
+        dir = dir.parent_path();
+    }
+
+    if (m_wd >= 0 && dir == m_watched) return;
+    if (m_wd >= 0) inotify_rm_watch(m_fd, m_wd);
+
+    // a file being written counts too, it may not have its size at first
+    m_wd = inotify_add_watch(m_fd, dir.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                             IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF |
+                             IN_MOVE_SELF | IN_ONLYDIR);
+    if (m_wd < 0) throw sys_error(dir.string());
+    m_watched = dir;
+}
+
+// whatever the events were, what matters is if the file there is the one mapped
+bool shm_source::update()
+{
+    struct stat st;
+
+    if (stat(m_fname.c_str(), &st) < 0 || size_t(st.st_size) < m_size) {
+        if (!m_data) return false;
+        unmap();
+        return true;
+    }
+
+    if (m_data && st.st_dev == m_dev && st.st_ino == m_ino) return false;
+
+    unmap();
+    map();
+    return true;
+}
+
+void shm_source::map()
+{
+    const int fd = open(m_fname.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) return; // gone again, there will be an event for it
+
+    struct stat st;
+    void *p = MAP_FAILED;
+
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= m_size) {
+        p = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (p == MAP_FAILED) return;
+
+    m_data = static_cast<const volatile uint8_t*>(p);
+    m_dev = st.st_dev;
+    m_ino = st.st_ino;
+}
+
+void shm_source::unmap()
+{
+    if (!m_data) return;
+
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+    m_data = nullptr;
+}
+
+bool shm_source::poll()
+{
+    alignas(inotify_event) char buf[4096];
+    bool any = false;
+
+    for (;;) {
+        const ssize_t n = read(m_fd, buf, sizeof(buf));
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            throw sys_error("inotify");
+        }
+        any = true;
+
+        // the watched directory has gone, a new watch is needed even if
+        // another one appears in its place
+        for (ssize_t i = 0; i < n;) {
+            const auto *e = reinterpret_cast<const inotify_event*>(buf + i);
+
+            if (e->mask & IN_IGNORED) m_wd = -1;
+            i += sizeof(inotify_event) + e->len;
+        }
+    }
+
+    if (!any) return false;
+
+    watch();
+    return update();
+}
+
+void shm_source::wait()
+{
+    while (!m_data) {
+        pollfd p = {m_fd, POLLIN, 0};
+
+        if (::poll(&p, 1, -1) < 0 && errno != EINTR) throw sys_error("poll");
+        poll();
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef SHM_SOURCE_H
+#define SHM_SOURCE_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include "telemetry_source.h"
+
+// The game's telemetry in shared memory, mapped whenever the file is there.
+// The directory is watched with inotify, so a game starting is noticed right
+// away, and the file being removed or replaced (the game restarting) leads
+// to unmapping or mapping the new one. If the directory doesn't exist yet,
+// the closest one above it is watched until it does.
+class shm_source : public telemetry_source {
+public:
+    shm_source(const std::string &fname, size_t size);
+    ~shm_source() override;
+
+    shm_source(const shm_source&) = delete;
+    shm_source& operator=(const shm_source&) = delete;
+
+    // deals with what has happened to the file, never blocks; returns true
+    // if the mapping has changed
+    bool poll() override;
+
+    // blocks until the file is mapped
+    void wait() override;
+
+    // nullptr while there's no file
+    const volatile uint8_t *data() const override { return m_data; }
+    size_t size() const override { return m_size; }
+    int fd() const override { return m_fd; }
+    bool in_place() const override { return true; }
+
+private:
+    void watch();
+    bool update();
+    void map();
+    void unmap();
+
+    std::string m_fname;
+    size_t m_size;
+
+    int m_fd;                           // inotify
+    int m_wd = -1;
+    std::string m_watched;
+
+    const volatile uint8_t *m_data = nullptr;
+    dev_t m_dev = 0;                    // of the mapped file
+    ino_t m_ino = 0;
+};
+
+#endif // SHM_SOURCE_H
@@ -0,0 +1,106 @@
+#include "snapshot.h"
+#include "stats.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+snapshot::snapshot(const span_set &spans)
+    : m_spans(spans)
+{
+    uint32_t pos = 0;
+
+    for (const auto &s: m_spans.spans()) {
+        // the same place within 8 bytes, so that values stay aligned
+        pos += (s.offset - pos) & 7;
+        m_local.push_back(pos);
+        pos += s.size;
+    }
+    m_size = pos;
+    m_lines = pos / sizeof(line) + 1;
+    m_buf.resize(2 * m_lines);
+}
+
+void snapshot::set_counter(uint32_t offset, uint32_t size)
+{
+    if (size > sizeof(uint64_t)) throw std::runtime_error("frame counter too big");
+
+    m_has_counter = true;
+    m_counter_offset = offset;
+    m_counter_size = size;
+}
+
+uint32_t snapshot::local(uint32_t offset) const
+{
+    const auto &s = m_spans.spans();
+    auto p = std::upper_bound(s.begin(), s.end(), offset,
+                              [](uint32_t o, const span_set::span &x) { return o < x.offset; });
+
+    if (p == s.begin() || offset >= std::prev(p)->offset + std::prev(p)->size) {
+        throw std::out_of_range("offset " + std::to_string(offset) + " is not in the snapshot");
+    }
+    --p;
+    return m_local[p - s.begin()] + (offset - p->offset);
+}
+
+uint64_t snapshot::counter(const volatile uint8_t *src) const
+{
+    uint64_t c = 0;
+
+    for (uint32_t i = 0; i < m_counter_size; ++i) {
+        c |= uint64_t(src[m_counter_offset + i]) << (8 * i);
+    }
+    return c;
+}
+
+void snapshot::copy(const volatile uint8_t *src, uint8_t *dst)
+{
+    const auto &s = m_spans.spans();
+
+    for (size_t i = 0; i < s.size(); ++i) {
+        std::memcpy(dst + m_local[i], (const uint8_t*)src + s[i].offset, s[i].size);
+    }
+}
+
+bool snapshot::copy_checked(const volatile uint8_t *src, uint8_t *dst, int retries)
+{
+    if (!m_has_counter) {
+        copy(src, dst);
+        return true;
+    }
+
+    for (int i = 0; i <= retries; ++i) {
+        const uint64_t before = counter(src);
+
+        m_taken_counter = before;
+
+        // neither the compiler nor the CPU may move the copy out of here
+        std::atomic_thread_fence(std::memory_order_acquire);
+        copy(src, dst);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (counter(src) == before) return true;
+    }
+    return false;
+}
+
+bool snapshot::take(const volatile uint8_t *src, int retries)
+{
+    // into the older copy, then it becomes the current one
+    const size_t next = m_cur? 0 : m_lines;
+    const bool ok = copy_checked(src, m_buf[next].b, retries);
+
+    // the gaps between spans are never written, the same zeros in both
+    m_changed = (m_takes == 0 || std::memcmp(m_buf[next].b, m_buf[m_cur].b, m_size) != 0);
+    m_cur = next;
+
+    ++m_takes;
+    moza::metrics->snapshots.add();
+    if (!m_changed) {
+        ++m_unchanged;
+        moza::metrics->snapshots_unchanged.add();
+    }
+    if (!ok) moza::metrics->snapshots_torn.add();
+
+    return ok;
+}
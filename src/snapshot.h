@@ -0,0 +1,67 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "spans.h"
+
+// A local copy of the telemetry spans in use, taken once per cycle so that
+// all indicators see the same consistent state and read it from a few cache
+// lines instead of all over the mapping. The spans are packed one after
+// another, keeping their alignment. The previous copy is kept to tell if
+// anything has changed since.
+class snapshot {
+public:
+    explicit snapshot(const span_set &spans);
+
+    // a field the game changes with each update, to check for torn copies
+    void set_counter(uint32_t offset, uint32_t size);
+
+    // where a telemetry offset is in the copy
+    uint32_t local(uint32_t offset) const;
+
+    // false if the counter kept changing during all the retries
+    bool take(const volatile uint8_t *src, int retries = 3);
+
+    bool has_counter() const { return m_has_counter; }
+    // the counter as it is in src, and as it was for the last copy
+    uint64_t counter(const volatile uint8_t *src) const;
+    uint64_t taken_counter() const { return m_taken_counter; }
+
+    // if the last copy differs from the one before it
+    bool changed() const { return m_changed; }
+
+    const uint8_t *data() const { return m_buf[m_cur].b; }
+    const span_set &spans() const { return m_spans; }
+
+    uint64_t takes() const { return m_takes; }
+    uint64_t unchanged() const { return m_unchanged; }
+
+private:
+    struct alignas(64) line {
+        uint8_t b[64];
+    };
+
+    void copy(const volatile uint8_t *src, uint8_t *dst);
+    bool copy_checked(const volatile uint8_t *src, uint8_t *dst, int retries);
+
+    span_set m_spans;
+    std::vector<uint32_t> m_local;      // where each span starts in the copy
+    std::vector<line> m_buf;            // the current and the previous copy
+    size_t m_lines = 0;                 // per copy
+    size_t m_size = 0;                  // bytes in use
+    size_t m_cur = 0;                   // in lines
+    bool m_changed = true;
+
+    uint64_t m_takes = 0;
+    uint64_t m_unchanged = 0;
+
+    bool m_has_counter = false;
+    uint32_t m_counter_offset = 0;
+    uint32_t m_counter_size = 0;
+    uint64_t m_taken_counter = 0;
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,33 @@
+#include "spans.h"
+#include <algorithm>
+
+void span_set::add(uint32_t offset, uint32_t size)
+{
+    auto p = std::lower_bound(m_spans.begin(), m_spans.end(), offset,
+                              [](const span &s, uint32_t o) { return s.offset < o; });
+
+    p = m_spans.insert(p, {offset, size});
+
+    // merge with the previous one, then swallow the following ones
+    if (p != m_spans.begin() && std::prev(p)->offset + std::prev(p)->size + m_gap >= p->offset) {
+        const uint32_t e = std::max(std::prev(p)->offset + std::prev(p)->size, p->offset + p->size);
+
+        p = std::prev(m_spans.erase(p));
+        p->size = e - p->offset;
+    }
+
+    auto q = std::next(p);
+
+    while (q != m_spans.end() && p->offset + p->size + m_gap >= q->offset) {
+        p->size = std::max(p->offset + p->size, q->offset + q->size) - p->offset;
+        q = m_spans.erase(q);
+    }
+}
+
+size_t span_set::bytes() const
+{
+    size_t n = 0;
+
+    for (const auto &s: m_spans) n += s.size;
+    return n;
+}
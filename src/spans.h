@@ -0,0 +1,31 @@
+#ifndef SPANS_H
+#define SPANS_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Byte ranges of the telemetry that are actually used, sorted and merged
+class span_set {
+public:
+    struct span {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    // ranges closer than gap bytes are merged too, as copying a few unused
+    // bytes is cheaper than handling another range
+    explicit span_set(uint32_t gap = 0) : m_gap(gap) {}
+
+    void add(uint32_t offset, uint32_t size);
+
+    const std::vector<span> &spans() const { return m_spans; }
+    size_t bytes() const;
+    uint32_t end() const { return m_spans.empty()? 0 : m_spans.back().offset + m_spans.back().size; }
+
+private:
+    uint32_t m_gap;
+    std::vector<span> m_spans;
+};
+
+#endif // SPANS_H
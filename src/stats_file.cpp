@@ -0,0 +1,208 @@
+#include "stats_file.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+std::runtime_error sys_error(const std::string &what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+int64_t realtime_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// the counters at one point, to get the rates from two of them
+struct sample {
+    explicit sample(const moza::stats &s)
+        : cycles(s.cycles.get()), evaluations(s.evaluations.get()),
+          frames(s.frames.get()), bytes(s.bytes.get()), game_frames(s.game_frames.get()),
+          t(std::chrono::steady_clock::now())
+    {}
+
+    uint64_t cycles, evaluations, frames, bytes, game_frames;
+    std::chrono::steady_clock::time_point t;
+};
+
+void print_histogram(std::ostream &out, const char *name, const moza::histogram &h)
+{
+    out << std::left << std::setw(22) << name << std::right;
+    if (!h.count()) {
+        out << "-" << std::endl;
+        return;
+    }
+    out << std::fixed << std::setprecision(1)
+        << "avg " << std::setw(8) << h.sum() / h.count() / 1000.0 << " us, "
+        << "p50 <" << std::setw(8) << h.quantile(0.5) / 1000.0 << " us, "
+        << "p99 <" << std::setw(8) << h.quantile(0.99) / 1000.0 << " us, "
+        << "max " << std::setw(8) << h.max() / 1000.0 << " us" << std::endl;
+}
+
+// the leds4sim recording in the file if it's still running, 0 if it's
+// left over from one that isn't
+pid_t owner(const std::string &fname)
+{
+    const int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    pid_t pid = 0;
+
+    if (fd < 0) return 0;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(moza::stats)) {
+        void *p = mmap(nullptr, sizeof(moza::stats), PROT_READ, MAP_SHARED, fd, 0);
+
+        if (p != MAP_FAILED) {
+            const auto &s = *static_cast<const moza::stats*>(p);
+
+            if (s.magic == moza::stats::magic_value) pid = s.pid;
+            munmap(p, sizeof(moza::stats));
+        }
+    }
+    close(fd);
+
+    if (pid > 0 && pid != getpid() && (kill(pid, 0) == 0 || errno == EPERM)) return pid;
+    return 0;
+}
+
+} // namespace
+
+stats_file::stats_file(const std::string &fname)
+    : m_fname(fname)
+{
+    int fd;
+
+    // never the file of a running one, its mapping would be truncated
+    // under it, and whichever exits first would remove it
+    while ((fd = open(fname.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644)) < 0) {
+        if (errno != EEXIST) throw sys_error(fname);
+        if (const pid_t pid = owner(fname)) {
+            throw std::runtime_error(fname + ": leds4sim " + std::to_string(pid) + " is already running");
+        }
+        if (unlink(fname.c_str()) < 0 && errno != ENOENT) throw sys_error(fname);
+    }
+    if (ftruncate(fd, sizeof(moza::stats)) < 0) {
+        close(fd);
+        unlink(fname.c_str());
+        throw sys_error(fname);
+    }
+
+    void *p = mmap(nullptr, sizeof(moza::stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+    if (p == MAP_FAILED) {
+        unlink(fname.c_str());
+        throw sys_error(fname);
+    }
+
+    m_stats = new (p) moza::stats;
+    m_stats->pid = getpid();
+    m_stats->started_ns = realtime_ns();
+    std::atomic_thread_fence(std::memory_order_release);
+    m_stats->magic = moza::stats::magic_value;
+
+    m_prev = moza::metrics;
+    moza::metrics = m_stats;
+}
+
+stats_file::~stats_file()
+{
+    moza::metrics = m_prev;
+    unlink(m_fname.c_str());
+    munmap(m_stats, sizeof(moza::stats));
+}
+
+void stats_file::print(const std::string &fname, std::ostream &out)
+{
+    const int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+
+    if (fd < 0) throw sys_error(fname);
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(moza::stats)) {
+        close(fd);
+        throw std::runtime_error(fname + ": not leds4sim stats");
+    }
+
+    void *p = mmap(nullptr, sizeof(moza::stats), PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+    if (p == MAP_FAILED) throw sys_error(fname);
+
+    const auto &s = *static_cast<const moza::stats*>(p);
+
+    if (s.magic != moza::stats::magic_value || s.layout != moza::stats::layout_version) {
+        munmap(p, sizeof(moza::stats));
+        throw std::runtime_error(fname + ": not leds4sim stats, or of another version");
+    }
+    if (kill(s.pid, 0) < 0 && errno == ESRCH) {
+        munmap(p, sizeof(moza::stats));
+        throw std::runtime_error(fname + ": leds4sim " + std::to_string(s.pid) + " isn't running");
+    }
+
+    const sample a(s);
+
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    const sample b(s);
+    const double t = std::chrono::duration<double>(b.t - a.t).count();
+
+    auto line = [&](const char *name, uint64_t total) -> std::ostream& {
+        return out << std::left << std::setw(22) << name << std::right << std::setw(12) << total;
+    };
+    auto rate = [&](uint64_t from, uint64_t to, const char *unit) {
+        out << std::fixed << std::setprecision(1) << std::setw(12) << (to - from) / t << " " << unit;
+    };
+
+    out << "leds4sim " << s.pid << ", up "
+        << (realtime_ns() - s.started_ns) / 1000000000 << " s" << std::endl;
+    line("cycles", b.cycles);                   rate(a.cycles, b.cycles, "/s");                 out << std::endl;
+    line("snapshots", s.snapshots.get())                    << std::endl;
+    line("snapshots unchanged", s.snapshots_unchanged.get()) << "   not evaluated" << std::endl;
+    line("snapshots torn", s.snapshots_torn.get())          << "   written during every copy" << std::endl;
+    line("evaluations", b.evaluations);         rate(a.evaluations, b.evaluations, "/s");       out << std::endl;
+    line("frames written", b.frames);           rate(a.frames, b.frames, "/s");                 out << std::endl;
+    line("bytes written", b.bytes);             rate(a.bytes, b.bytes, "B/s");                  out << std::endl;
+    line("frames suppressed", s.frames_suppressed.get())    << "   already shown" << std::endl;
+    line("changes suppressed", s.changes_suppressed.get())  << "   hysteresis, hold times" << std::endl;
+    line("states dropped", s.states_dropped.get())          << "   newer ones came first" << std::endl;
+    line("NOK retries", s.nok_retries.get())                << std::endl;
+    line("read timeouts", s.read_timeouts.get())            << std::endl;
+    if (b.game_frames) {
+        line("game frames", b.game_frames);     rate(a.game_frames, b.game_frames, "/s");       out << std::endl;
+        line("game frames missed", s.game_frames_missed.get())  << std::endl;
+    }
+    const uint32_t asked = s.rt_requested.load(std::memory_order_relaxed);
+    const uint32_t applied = s.rt_applied.load(std::memory_order_relaxed);
+    static const std::pair<uint32_t, const char*> settings[] = {
+        {moza::stats::RT_PRIORITY, "loop priority"},
+        {moza::stats::RT_AFFINITY, "loop CPUs"},
+        {moza::stats::RT_SERIAL_PRIORITY, "serial priority"},
+        {moza::stats::RT_SERIAL_AFFINITY, "serial CPUs"},
+        {moza::stats::RT_LOCK_MEMORY, "memory locked"},
+        {moza::stats::RT_PREFAULT, "prefaulted"},
+    };
+
+    for (const auto &r: settings) {
+        if (!(asked & r.first)) continue;
+        out << std::left << std::setw(22) << r.second << std::right << std::setw(12)
+            << (applied & r.first? "applied" : "failed") << std::endl;
+    }
+    print_histogram(out, "cycle", s.cycle);
+    print_histogram(out, "evaluation", s.evaluation);
+    print_histogram(out, "write", s.write);
+
+    munmap(p, sizeof(moza::stats));
+}
@@ -0,0 +1,30 @@
+#ifndef STATS_FILE_H
+#define STATS_FILE_H
+
+#include <ostream>
+#include <string>
+
+#include <stats.h>
+
+// The counters of this process in a shared file, normally on a tmpfs, for
+// `leds4sim --stats` to read while it runs. Everything is recorded there
+// from construction on; on destruction the file is removed.
+class stats_file {
+public:
+    explicit stats_file(const std::string &fname);
+    ~stats_file();
+
+    stats_file(const stats_file&) = delete;
+    stats_file& operator=(const stats_file&) = delete;
+
+    // those of a running leds4sim, with the rates over a second; throws
+    // std::runtime_error if there's none
+    static void print(const std::string &fname, std::ostream &out);
+
+private:
+    std::string m_fname;
+    moza::stats *m_stats;
+    moza::stats *m_prev;                // where it was recorded before
+};
+
+#endif // STATS_FILE_H
@@ -0,0 +1,19 @@
+#include "telemetry_source.h"
+#include "shm_source.h"
+#include "udp_source.h"
+
+#include <stdexcept>
+
+std::unique_ptr<telemetry_source> make_source(const source_options &opt)
+{
+    if (opt.size == 0) throw std::runtime_error("the telemetry size must be more than 0");
+
+    if (opt.type == "shm") {
+        return std::make_unique<shm_source>(opt.file, opt.size);
+    }
+    if (opt.type == "udp") {
+        if (opt.port > 65535) throw std::runtime_error("UDP port must be 0 to 65535");
+        return std::make_unique<udp_source>(opt.address, opt.port, opt.size, opt.timeout_ms);
+    }
+    throw std::runtime_error("unknown telemetry source \"" + opt.type + "\", it's \"shm\" or \"udp\"");
+}
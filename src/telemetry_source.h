@@ -0,0 +1,47 @@
+#ifndef TELEMETRY_SOURCE_H
+#define TELEMETRY_SOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct source_options {
+    std::string type = "shm";           // or "udp"
+    unsigned int size = 0;              // of the telemetry image
+
+    std::string file;                   // shm
+    std::string address = "127.0.0.1"; // udp, to listen on
+    unsigned int port = 0;
+    unsigned int timeout_ms = 1000;     // without datagrams, the game is gone
+};
+
+// Where the telemetry comes from: an image of size() bytes the offsets in
+// the config are into. data() is nullptr while the game isn't there, and
+// may point somewhere else after each poll().
+class telemetry_source {
+public:
+    virtual ~telemetry_source() = default;
+
+    // deals with what has come in, never blocks; returns true if the game
+    // has appeared, gone or restarted
+    virtual bool poll() = 0;
+
+    // blocks until there's telemetry
+    virtual void wait() = 0;
+
+    // readable when poll() has something to deal with
+    virtual int fd() const = 0;
+
+    virtual const volatile uint8_t *data() const = 0;
+    virtual size_t size() const = 0;
+
+    // if the game writes over the image in place, so that waiting for its
+    // frame counter to change makes sense
+    virtual bool in_place() const = 0;
+};
+
+// "shm" for a file in shared memory, "udp" for datagrams to a local port
+std::unique_ptr<telemetry_source> make_source(const source_options &opt);
+
+#endif // TELEMETRY_SOURCE_H
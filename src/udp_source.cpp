@@ -0,0 +1,128 @@
+#include "udp_source.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+namespace {
+
+std::runtime_error sys_error(const std::string &what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+int64_t now_ns()
+{
+    timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+} // namespace
+
+udp_source::udp_source(const std::string &address, uint16_t port, size_t size, unsigned int timeout_ms)
+    : m_fd(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)),
+      m_port(port), m_size(size), m_stride((size + 63) & ~size_t(63)),
+      m_timeout_ns(int64_t(timeout_ms) * 1000000)
+{
+    if (m_fd < 0) throw sys_error("socket");
+
+    sockaddr_in a = {};
+
+    a.sin_family = AF_INET;
+    a.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &a.sin_addr) != 1) {
+        close(m_fd);
+        throw std::runtime_error("not an IPv4 address: " + address);
+    }
+
+    socklen_t len = sizeof(a);
+
+    if (bind(m_fd, reinterpret_cast<sockaddr*>(&a), len) < 0 ||
+        getsockname(m_fd, reinterpret_cast<sockaddr*>(&a), &len) < 0) {
+        const auto e = sys_error(address + ":" + std::to_string(port));
+
+        close(m_fd);
+        throw e;
+    }
+    m_port = ntohs(a.sin_port);
+
+    // a datagram longer than the image is cut short, the rest isn't needed
+    m_buf.assign(2 * batch * m_stride, 0);
+    m_iov.resize(2 * batch);
+    m_msgs.resize(2 * batch);
+    for (unsigned int i = 0; i < 2 * batch; ++i) {
+        m_iov[i] = {m_buf.data() + i * m_stride, m_size};
+        m_msgs[i].msg_hdr = {};
+        m_msgs[i].msg_hdr.msg_iov = &m_iov[i];
+        m_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+udp_source::~udp_source()
+{
+    close(m_fd);
+}
+
+// all there is, the latest one becomes the image; a full batch may mean
+// there's more, received into the same bank again
+bool udp_source::receive()
+{
+    mmsghdr *msgs = &m_msgs[m_bank * batch];
+    int latest = -1;
+
+    for (;;) {
+        const int n = recvmmsg(m_fd, msgs, batch, MSG_DONTWAIT, nullptr);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            throw sys_error("recvmmsg");
+        }
+        if (n == 0) break;
+
+        m_skipped += (latest >= 0) + n - 1;
+        m_received += n;
+        latest = n - 1;
+        if (n < int(batch)) break;
+    }
+
+    if (latest < 0) return false;
+
+    uint8_t *p = m_buf.data() + (m_bank * batch + latest) * m_stride;
+    const size_t len = msgs[latest].msg_len;
+
+    if (len < m_size) std::memset(p + len, 0, m_size - len);
+    m_data = p;
+    m_bank ^= 1;
+    return true;
+}
+
+bool udp_source::poll()
+{
+    const bool had = (m_data != nullptr);
+    const int64_t now = now_ns();
+
+    if (receive()) {
+        m_last_at = now;
+    } else if (m_data && now - m_last_at >= m_timeout_ns) {
+        m_data = nullptr;
+    }
+    return had != (m_data != nullptr);
+}
+
+void udp_source::wait()
+{
+    while (!m_data) {
+        pollfd p = {m_fd, POLLIN, 0};
+
+        if (::poll(&p, 1, -1) < 0 && errno != EINTR) throw sys_error("poll");
+        poll();
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef UDP_SOURCE_H
+#define UDP_SOURCE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/socket.h>
+
+#include "telemetry_source.h"
+
+// Telemetry sent as UDP datagrams, like many sims do: the latest one is the
+// telemetry image, the offsets are into it, and what a shorter one lacks is
+// zeros. They're received in batches by recvmmsg straight into buffers
+// allocated once, in two banks taking turns, so that the image in use is
+// never written over by the next batch. The game is gone when nothing has
+// come for the timeout.
+class udp_source : public telemetry_source {
+public:
+    // port 0 for any free one
+    udp_source(const std::string &address, uint16_t port, size_t size, unsigned int timeout_ms);
+    ~udp_source() override;
+
+    udp_source(const udp_source&) = delete;
+    udp_source& operator=(const udp_source&) = delete;
+
+    bool poll() override;
+    void wait() override;
+
+    const volatile uint8_t *data() const override { return m_data; }
+    size_t size() const override { return m_size; }
+    int fd() const override { return m_fd; }
+    bool in_place() const override { return false; }
+
+    // the one bound to
+    uint16_t port() const { return m_port; }
+
+    uint64_t received() const { return m_received; }
+    // replaced by a newer one in the same batch, never seen
+    uint64_t skipped() const { return m_skipped; }
+
+private:
+    static constexpr unsigned int batch = 16;
+
+    bool receive();
+
+    int m_fd;
+    uint16_t m_port;
+    size_t m_size;
+    size_t m_stride;                    // between buffers, whole cache lines
+    int64_t m_timeout_ns;
+
+    std::vector<uint8_t> m_buf;         // 2 banks of batch buffers
+    std::vector<iovec> m_iov;
+    std::vector<mmsghdr> m_msgs;
+    unsigned int m_bank = 0;            // to receive into next
+
+    const uint8_t *m_data = nullptr;
+    int64_t m_last_at = 0;              // when the latest one came
+
+    uint64_t m_received = 0;
+    uint64_t m_skipped = 0;
+};
+
+#endif // UDP_SOURCE_H
@@ -0,0 +1,80 @@
+// A MOZA device emulated on a pseudo-terminal: run leds4sim with --port set
+// to the printed path, and every frame it sends is printed with a timestamp.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <getopt.h>
+
+#include <emulator.h>
+
+using namespace std;
+
+namespace {
+
+void check_opts(int argc, char* argv[], moza::emulator_options &opts)
+{
+    int optc;
+
+    for (;;) {
+        int option_index = 0;
+        static struct option long_options[] = {
+            {"delay", required_argument, 0, 'D'},
+            {"nok", required_argument, 0, 'k'},
+            {"garbage", required_argument, 0, 'g'},
+            {0, 0, 0, 0}
+        };
+
+        optc = getopt_long(argc, argv, "D:k:g:", long_options, &option_index);
+        if (optc == -1 ) break;
+
+        switch (optc) {
+            case 'D':
+                opts.delay_ms = atoi(optarg);
+                break;
+            case 'k':
+                opts.nok = atof(optarg);
+                break;
+            case 'g':
+                opts.garbage = atof(optarg);
+                break;
+            default:
+                cerr << "Usage: " << argv[0] << " [-D|--delay ms] [-k|--nok p] [-g|--garbage p]" << endl;
+                cerr << "\t-D, --delay\tdelay before replies, ms (default 2)" << endl;
+                cerr << "\t-k, --nok\tprobability of a reply with a wrong checksum" << endl;
+                cerr << "\t-g, --garbage\tprobability of junk bytes before a reply" << endl;
+                exit(EXIT_FAILURE);
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    moza::emulator_options opts;
+
+    check_opts(argc, argv, opts);
+
+    moza::emulator emu(opts);
+    const auto start = moza::emulator::clock::now();
+
+    emu.on_frame([&](const moza::emulator::received &r) {
+        const chrono::duration<double> t = r.t - start;
+
+        cout << fixed << setprecision(6) << setw(12) << t.count() << (r.ok? "  " : " !");
+        for (auto b: r.data) {
+            cout << ' ' << hex << setw(2) << setfill('0') << int(b);
+        }
+        cout << dec << setfill(' ') << endl;
+    });
+
+    cout << emu.path() << endl;
+
+    for (;;) pause();
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+// Decodes a serial trace written by leds4sim (on SIGUSR1, or on exit with
+// --debug): every frame sent or received, with its time and fd, the LED
+// commands spelled out.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <utility>
+#include <cstdlib>
+#include <cstring>
+
+#include <parser.h>
+#include <trace.h>
+
+using namespace std;
+
+namespace {
+
+const char *set_name(uint8_t ctl)
+{
+    switch (ctl) {
+    case 0:     return "RPM";
+    case 1:     return "BUTTON";
+    default:    return "?";
+    }
+}
+
+const char *mode_name(uint8_t m)
+{
+    switch (m) {
+    case 0:     return "off";
+    case 1:     return "telemetry";
+    case 2:     return "on";
+    default:    return "?";
+    }
+}
+
+string color(const uint8_t *p)
+{
+    ostringstream s;
+
+    s << '#' << hex << setfill('0') << setw(2) << int(p[0]) << setw(2) << int(p[1])
+      << setw(2) << int(p[2]);
+    return s.str();
+}
+
+// start, length, group, device, command, payload, checksum
+string describe(const uint8_t *f, size_t size)
+{
+    if (size < 6) return "short frame";
+
+    ostringstream s;
+    const uint8_t group = f[2];
+    const uint8_t cmd = f[4];
+    const uint8_t *p = f + 5;
+    const size_t n = size - 6;                  // payload
+
+    if (group & 0x80)           s << "reply  ";
+    else if (group == 0x40)     s << "read   ";
+    else if (group == 0x3f)     s << "write  ";
+    else                        s << "group " << hex << int(group) << dec << " ";
+
+    if (cmd == 0x19 && n >= 1) {
+        s << "colors " << set_name(p[0]);
+        for (size_t i = 1; i + 4 <= n; i += 4) s << ' ' << int(p[i]) + 1 << '=' << color(p + i + 1);
+    } else if (cmd == 0x1a && n >= 5) {
+        const uint32_t mask = p[1] | p[2] << 8 | p[3] << 16 | uint32_t(p[4]) << 24;
+
+        s << "mask   " << set_name(p[0]) << " 0x" << hex << setw(8) << setfill('0') << mask << dec
+          << " (" << __builtin_popcount(mask) << " lit)";
+    } else if (cmd == 0x1c && n >= 2) {
+        // set as (0, mode), read as (set, 0) and answered with (set, mode)
+        s << "mode   ";
+        if (group == 0x3f)  s << mode_name(p[1]);
+        else                s << set_name(p[0]) << (group & 0x80? string(" ") + mode_name(p[1]) : "");
+    } else if (cmd == 0x1f && n >= 6) {
+        s << "color  " << set_name(p[0]) << ' ' << int(p[2]) + 1;
+        if (group != 0x40) s << ' ' << color(p + 3);
+    } else {
+        s << "cmd " << hex << setfill('0') << setw(2) << int(cmd) << ':';
+        for (size_t i = 0; i < n; ++i) s << ' ' << setw(2) << int(p[i]);
+    }
+    return s.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        cerr << "Usage: " << argv[0] << " trace-file" << endl;
+        return EXIT_FAILURE;
+    }
+
+    ifstream f(argv[1], ios::binary);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+
+    f.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    f.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!f || magic != moza::trace::magic || version != moza::trace::version) {
+        cerr << argv[1] << ": not a leds4sim serial trace, or of another version" << endl;
+        return EXIT_FAILURE;
+    }
+
+    // a stream per fd and direction, frames may span records
+    map<pair<int16_t, uint8_t>, moza::parser> streams;
+    int64_t start = -1;
+
+    for (;;) {
+        int64_t t;
+        uint8_t dir;
+        int16_t fd;
+        uint8_t size;
+        uint8_t data[moza::trace::chunk];
+
+        f.read(reinterpret_cast<char*>(&t), sizeof(t));
+        f.read(reinterpret_cast<char*>(&dir), sizeof(dir));
+        f.read(reinterpret_cast<char*>(&fd), sizeof(fd));
+        f.read(reinterpret_cast<char*>(&size), sizeof(size));
+        if (!f || size > sizeof(data)) break;
+        f.read(reinterpret_cast<char*>(data), size);
+        if (!f) break;
+
+        if (start < 0) start = t;
+
+        // what leds4sim sends has only the checksum escaped
+        auto &in = streams.try_emplace(make_pair(fd, dir), dir == moza::trace::TX?
+                                       moza::parser::CHECKSUM : moza::parser::ALL).first->second;
+
+        in.feed(data, size);
+        while (in.next()) {
+            cout << fixed << setprecision(6) << setw(12) << (t - start) * 1e-9
+                 << "  fd " << setw(2) << fd << (dir == moza::trace::TX? " > " : " < ")
+                 << (in.ok()? ' ' : '!') << ' ' << describe(in.data(), in.size()) << endl;
+        }
+    }
+
+    return 0;
+}